@@ -0,0 +1,120 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "parser.h"
+
+/**
+ * packrat benchmark
+ *
+ * parses with and without a memo table. first a grammar that backtracks
+ * badly: every s tries two alternatives that both read the s after it
+ * before they fail, which is exponential in the input length unless the
+ * inner results are remembered. then the lispy readers on a generated
+ * file, to show what the table costs on a grammar that does not need it.
+ */
+
+#define MEMO_SLOTS 65536
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_backtracking(void) {
+    mpc_parser_t* S   = mpc_new("s");
+    mpc_parser_t* Top = mpc_new("top");
+    mpca_lang(MPCA_LANG_DEFAULT,
+        " s   : 'a' <s> 'b' | 'a' <s> 'c' | 'a' ; "
+        " top : /^/ <s> /$/ ;                     ",
+        S, Top, NULL);
+    mpc_parser_t* memo = mpc_memo(Top, MEMO_SLOTS,
+        (mpc_dup_t)mpc_ast_copy, (mpc_dtor_t)mpc_ast_delete);
+
+    int sizes[] = { 12, 16, 20 };
+    for (int k=0; k < 3; k++) {
+        int n = sizes[k];
+        /* n a's then n-1 c's */
+        char* input = malloc(2*n);
+        memset(input, 'a', n);
+        memset(input + n, 'c', n-1);
+        input[2*n-1] = '\0';
+
+        printf("backtracking n=%-8i", n);
+        mpc_parser_t* ps[] = { Top, memo };
+        char* names[] = { "plain", "memo" };
+        for (int j=0; j < 2; j++) {
+            mpc_result_t r;
+            double start = now();
+            int ok = mpc_parse("input", input, ps[j], &r);
+            double elapsed = now() - start;
+            printf("  %s %10.3fms", names[j], elapsed * 1000);
+            if (ok) {
+                mpc_ast_delete(r.output);
+            } else {
+                printf(" (failed)");
+                mpc_err_delete(r.error);
+            }
+        }
+        putchar('\n');
+        free(input);
+    }
+
+    mpc_delete(memo);
+    mpc_cleanup(2, S, Top);
+}
+
+static void generate(char* filename, int n) {
+    FILE* f = fopen(filename, "w");
+    for (int i=0; i < n; i++) {
+        fprintf(f, "; definition %i\n", i);
+        fprintf(f, "(def {value-%i} (list %i -%i \"str\\t%i\\n\" {a b (c d)}))\n",
+            i, i, i * 7, i);
+        fprintf(f, "(fun {f-%i x y} {if (> x y) {+ x %i} {* y (- x 1)}})\n",
+            i, i);
+    }
+    fclose(f);
+}
+
+static void bench_reader(char* filename, int reader) {
+    lval* first = NULL;
+    parser_reader = reader;
+    printf("%-6s %-16s", reader == READER_FOLD ? "fold" : "mpc", filename);
+
+    int memo[] = { 0, MEMO_SLOTS };
+    for (int j=0; j < 2; j++) {
+        parser_memo = memo[j];
+        double start = now();
+        lval* x = lval_read_file(filename);
+        double elapsed = now() - start;
+        printf("  %s %10.3fms", j ? "memo" : "plain", elapsed * 1000);
+
+        if (!first) {
+            first = x;
+        } else {
+            if (!lval_eq(first, x)) { printf(" MISMATCH"); }
+            lval_del(x);
+        }
+    }
+    parser_memo = 0;
+    putchar('\n');
+    lval_del(first);
+}
+
+int main(int argc, char** argv) {
+    bench_backtracking();
+
+    init_parser();
+    char* filename = "bench_packrat.lsp";
+    generate(filename, 2000);
+    bench_reader(filename, READER_MPC);
+    bench_reader(filename, READER_FOLD);
+    remove(filename);
+    free_parser();
+    return 0;
+}
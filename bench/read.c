@@ -0,0 +1,90 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "types.h"
+#include "parser.h"
+
+/**
+ * reader benchmark
+ *
+ * reads prelude.lsp and generated files of increasing size with every
+ * reader, checks that they all produce the same values and prints the
+ * time each took.
+ */
+
+static char* readers[] = { "mpc", "native", "fold" };
+#define NREADERS (int)(sizeof(readers) / sizeof(readers[0]))
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * a file of n definitions exercising every kind of token
+ */
+static void generate(char* filename, int n) {
+    FILE* f = fopen(filename, "w");
+    for (int i=0; i < n; i++) {
+        fprintf(f, "; definition %i\n", i);
+        fprintf(f, "(def {value-%i} (list %i -%i \"str\\t%i\\n\" {a b (c d)}))\n",
+            i, i, i * 7, i);
+        fprintf(f, "(fun {f-%i x y} {if (> x y) {+ x %i} {* y (- x 1)}})\n",
+            i, i);
+    }
+    fclose(f);
+}
+
+static void bench(char* filename, int repeat) {
+    lval* first = NULL;
+    printf("%-20s", filename);
+    for (int k=0; k < NREADERS; k++) {
+        parser_reader = k;
+
+        double start = now();
+        lval* x = NULL;
+        for (int i=0; i < repeat; i++) {
+            if (x) { lval_del(x); }
+            x = lval_read_file(filename);
+        }
+        double elapsed = (now() - start) / repeat;
+
+        printf("  %s %8.3fms", readers[k], elapsed * 1000);
+        if (x->type == LVAL_ERR) {
+            printf(" (");
+            lval_print(x);
+            printf(")");
+        }
+
+        if (!first) {
+            first = x;
+        } else {
+            if (!lval_eq(first, x)) { printf(" MISMATCH"); }
+            lval_del(x);
+        }
+    }
+    putchar('\n');
+    lval_del(first);
+}
+
+int main(int argc, char** argv) {
+    init_parser();
+
+    bench("prelude.lsp", 50);
+
+    int sizes[] = { 1000, 10000, 50000 };
+    for (int i=0; i < 3; i++) {
+        char filename[64];
+        sprintf(filename, "bench_read_%i.lsp", sizes[i]);
+        generate(filename, sizes[i]);
+        bench(filename, i < 2 ? 5 : 1);
+        remove(filename);
+    }
+
+    free_parser();
+    return 0;
+}
@@ -0,0 +1,115 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "parser.h"
+
+/**
+ * startup benchmark
+ *
+ * times init_parser and free_parser, which every run of lispy pays before
+ * it reads anything, against building the same grammar from its text with
+ * mpca_lang. the two are then checked to parse prelude.lsp and a generated
+ * file to the same asts.
+ */
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* the mpc reader's grammar from parser.c */
+extern mpc_parser_t* Program;
+
+static mpc_parser_t* lang[8];
+
+static void init_lang(void) {
+    char* names[] = { "number", "symbol", "string", "comment",
+        "sexpr", "qexpr", "expr", "program" };
+    for (int i=0; i < 8; i++) { lang[i] = mpc_new(names[i]); }
+
+    mpca_lang(MPCA_LANG_DEFAULT,
+            "                                                \
+                number  : /-?[0-9]+/ ;                       \
+                symbol  : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ; \
+                string  : /\"(\\\\.|[^\"\\\\])*\"/ ;         \
+                comment : /;[^\\r\\n]*/ ;                    \
+                sexpr   : '(' <expr>* ')' ;                  \
+                qexpr   : '{' <expr>* '}' ;                  \
+                expr    : <number> | <symbol> | <string>     \
+                        | <comment> | <sexpr> | <qexpr> ;    \
+                program : /^/ <expr>* /$/ ;                  \
+            ",
+            lang[0], lang[1], lang[2], lang[3],
+            lang[4], lang[5], lang[6], lang[7]);
+}
+
+static void free_lang(void) {
+    mpc_cleanup(8, lang[0], lang[1], lang[2], lang[3],
+        lang[4], lang[5], lang[6], lang[7]);
+}
+
+static void bench(char* name, void (*init)(void), void (*done)(void),
+        int repeat) {
+    double start = now();
+    for (int i=0; i < repeat; i++) {
+        init();
+        done();
+    }
+    double elapsed = (now() - start) / repeat;
+    printf("%-12s %10.3fus\n", name, elapsed * 1e6);
+}
+
+static void generate(char* filename, int n) {
+    FILE* f = fopen(filename, "w");
+    for (int i=0; i < n; i++) {
+        fprintf(f, "; definition %i\n", i);
+        fprintf(f, "(def {value-%i} (list %i -%i \"str\\t%i\\n\" {a b (c d)}))\n",
+            i, i, i * 7, i);
+        fprintf(f, "(fun {f-%i x y} {if (> x y) {+ x %i} {* y (- x 1)}})\n",
+            i, i);
+    }
+    fclose(f);
+}
+
+static void check(char* filename) {
+    mpc_result_t a, b;
+    int ok_a = mpc_parse_contents(filename, Program, &a);
+    int ok_b = mpc_parse_contents(filename, lang[7], &b);
+
+    int same = ok_a == ok_b;
+    if (same && ok_a) {
+        same = mpc_ast_eq(a.output, b.output);
+    } else if (same) {
+        char* ea = mpc_err_string(a.error);
+        char* eb = mpc_err_string(b.error);
+        same = strcmp(ea, eb) == 0;
+        free(ea);
+        free(eb);
+    }
+    printf("%-20s %s\n", filename, same ? "same" : "MISMATCH");
+
+    if (ok_a) { mpc_ast_delete(a.output); } else { mpc_err_delete(a.error); }
+    if (ok_b) { mpc_ast_delete(b.output); } else { mpc_err_delete(b.error); }
+}
+
+int main(int argc, char** argv) {
+    bench("init_parser", init_parser, free_parser, 1000);
+    bench("mpca_lang", init_lang, free_lang, 1000);
+
+    init_parser();
+    init_lang();
+    check("prelude.lsp");
+    char* filename = "bench_startup.lsp";
+    generate(filename, 1000);
+    check(filename);
+    remove(filename);
+    free_lang();
+    free_parser();
+    return 0;
+}
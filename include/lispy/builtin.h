@@ -5,6 +5,8 @@
 
 void lenv_add_builtin(lenv* e, char* name, lbuiltin func);
 void lenv_add_builtins(lenv* e);
+char* builtin_name(lbuiltin func);
+lbuiltin builtin_find(char* name);
 
 /* arithmetic */
 
@@ -27,22 +29,34 @@ lval* builtin_cmp(lenv* e, lval* a, char* op);
 lval* builtin_eq(lenv* e, lval* a);
 lval* builtin_ne(lenv* e, lval* a);
 
+/* loops */
+lval* builtin_while(lenv* e, lval* a);
+lval* builtin_dotimes(lenv* e, lval* a);
+lval* builtin_foreach(lenv* e, lval* a);
+
 /* list functions */
 lval* builtin_head(lenv* e, lval* a);
 lval* builtin_tail(lenv* e, lval* a);
 lval* builtin_list(lenv* e, lval* a);
 lval* builtin_eval(lenv* e, lval* a);
+lval* builtin_apply(lenv* e, lval* a);
 lval* builtin_join(lenv* e, lval* a);
+lval* builtin_do(lenv* e, lval* a);
 
 /* assignment */
 lval* builtin_def(lenv* e, lval* a);
 lval* builtin_put(lenv* e, lval* a);
 lval* builtin_var(lenv* e, lval* a, char* func);
+lval* builtin_set(lenv* e, lval* a);
 lval* builtin_lambda(lenv* e, lval* a);
+lval* builtin_let(lenv* e, lval* a);
 
 /* strings */
 lval* builtin_load(lenv* e, lval* a);
 lval* builtin_print(lenv* e, lval* a);
 lval* builtin_error(lenv* e, lval* a);
 
+/* introspection */
+lval* builtin_mem(lenv* e, lval* a);
+
 #endif
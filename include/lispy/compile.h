@@ -0,0 +1,8 @@
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include "types.h"
+
+lval* compile_c(lenv* e, char* outfile, int nfiles, char** files);
+
+#endif
@@ -5,6 +5,17 @@
 
 lval* lval_eval_sexpr(lenv* e, lval* v);
 lval* lval_eval(lenv* e, lval* v);
+lval* lval_eval_ref(lenv* e, lval* v);
+lval* lval_eval_body(lenv* e, lval* v);
 lval* lval_call(lenv* e, lval* f, lval* a);
 
+/* limits on a top-level evaluation. 0 means unlimited */
+void lbudget_set(long max_steps, long timeout_ms);
+void lbudget_start(void);
+void lbudget_stop(void);
+int lbudget_running(void);
+void lbudget_cancel(void);
+int lbudget_exceeded(void);
+lval* lbudget_step(void);
+
 #endif
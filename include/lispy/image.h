@@ -0,0 +1,9 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "types.h"
+
+lval* image_dump(lenv* e, char* filename);
+lval* image_load(lenv* e, char* filename);
+
+#endif
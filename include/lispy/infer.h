@@ -0,0 +1,14 @@
+#ifndef INFER_H
+#define INFER_H
+
+#include "types.h"
+
+/* calls with more arguments than this are always boxed */
+#define INFER_MAX_ARGS 8
+
+extern int infer_enabled;
+
+int lval_infer_numeric(lval* f);
+lval* lval_call_numeric(lenv* e, lval* f, lval* a);
+
+#endif
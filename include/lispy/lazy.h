@@ -0,0 +1,9 @@
+#ifndef LAZY_H
+#define LAZY_H
+
+#include "types.h"
+
+lval* lazy_load(lenv* e, char* filename);
+void lazy_free(void);
+
+#endif
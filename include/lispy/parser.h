@@ -4,6 +4,15 @@
 #include "types.h"
 #include "mpc.h"
 
+/* which reader turns source text into values */
+enum { READER_MPC, READER_NATIVE, READER_FOLD };
+extern int parser_reader;
+
+/* slots in the packrat table of the mpc and fold readers, 0 for none */
+extern int parser_memo;
+
+/* the mpc and fold grammars. parse and lval_read_file build them when
+ * first needed; both calls may be repeated */
 void init_parser(void);
 void free_parser(void);
 
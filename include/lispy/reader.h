@@ -0,0 +1,16 @@
+#ifndef READER_H
+#define READER_H
+
+#include "types.h"
+
+typedef struct lstream lstream;
+
+lval* reader_read(char* name, char* input, long len);
+
+/* top-level forms one at a time from a file, "-" for stdin, or an fd */
+lstream* lstream_open(char* filename);
+lstream* lstream_fdopen(char* name, int fd);
+lval* lstream_next(lstream* s, lval** err);
+void lstream_close(lstream* s);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef SHAKE_H
+#define SHAKE_H
+
+#include "types.h"
+
+lval* shake_bundle(char* outfile, int nfiles, char** files);
+lval* shake_env(lenv* e, lval* forms);
+int shake_has(lval* names, char* sym);
+
+#endif
@@ -1,6 +1,9 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <stddef.h>
+#include <stdio.h>
+
 struct lval;
 struct lenv;
 typedef struct lval lval;
@@ -8,9 +11,14 @@ typedef struct lenv lenv;
 
 enum { LVAL_ERR, LVAL_NUM, LVAL_SYM, LVAL_STR,
        LVAL_FUN, LVAL_SEXPR, LVAL_QEXPR };
-enum { LERR_DIV_ZERO, LERR_BAD_OP, LERR_BAD_NUM };
+/* errors with a fixed message are static; see lval_err_code */
+enum { LERR_OTHER = -1, LERR_DIV_ZERO, LERR_BAD_NUM,
+       LERR_BAD_FORMALS, LERR_STEPS, LERR_TIMEOUT, LERR_CANCELLED,
+       LERR_NO_MEM, LERR_COUNT };
 
 typedef lval*(*lbuiltin)(lenv*, lval*);
+/* compiled numeric lambda body; see compile.c */
+typedef lval*(*lnative)(lenv*, long*);
 
 struct lval {
     int type;
@@ -24,6 +32,11 @@ struct lval {
     lenv* env;
     lval* formals;
     lval* body;
+    int arity;      /* formals before '&' */
+    int variadic;   /* formals contain '&' */
+    int numeric;    /* as a lambda body, can run unboxed; see infer.c */
+    lnative native; /* as a lambda body, compiled code for it, or NULL */
+    int refs;       /* lambdas sharing this as formals or body */
 
     int count;
     lval** cell;
@@ -32,13 +45,27 @@ struct lval {
 struct lenv {
     lenv* par;
     int count;
+    int cap;
+    int borrowed;   /* leading syms not owned by this env */
     char** syms;
     lval** vals;
 };
 
+/* accounted allocation, used for everything lval_del and lenv_del free */
+void* lalloc(size_t n);
+void* lrealloc(void* p, size_t n);
+void lfree(void* p);
+
+void lmem_set_quota(size_t bytes);
+size_t lmem_quota(void);
+size_t lmem_current(void);
+size_t lmem_max(void);
+int lmem_exceeded(void);
+
 /* variable functions */
 lval* lval_num(long x);
 lval* lval_err(char* fmt, ...);
+lval* lval_err_code(int code);
 lval* lval_sym(char* s);
 lval* lval_str(char* s);
 lval* lval_sexpr(void);
@@ -55,8 +82,10 @@ lval* lval_pop(lval* v, int i);
 lval* lval_take(lval* v, int i);
 lval* lval_join(lval* x, lval* y);
 
-void lval_expr_print(lval* v, char open, char close);
-void lval_string_print(lval* v);
+void lval_expr_print(FILE* f, lval* v, char open, char close);
+void lval_expr_print_from(FILE* f, lval* v, int start, char open, char close);
+void lval_string_print(FILE* f, lval* v);
+void lval_fprint(FILE* f, lval* v);
 void lval_print(lval* v);
 void lval_println(lval* v);
 char* ltype_name(int t);
@@ -68,6 +97,15 @@ void lenv_del(lenv* e);
 lenv* lenv_copy(lenv* e);
 void lenv_def(lenv* e, lval* k, lval* v);
 lval* lenv_get(lenv* e, lval* k);
+extern int (*lenv_on_miss)(lenv* e, char* sym);
+lval* lenv_lookup(lenv* e, char* sym);
 void lenv_put(lenv* e, lval* k, lval* v);
+int lenv_set(lenv* e, lval* k, lval* v);
+void lenv_bind(lenv* e, char* sym, lval* v);
+void lenv_bind_borrowed(lenv* e, char* sym, lval* v);
+
+/* scratch frames for let and friends, released in LIFO order */
+lenv* lenv_push(lenv* par);
+void lenv_pop(lenv* e);
 
 #endif
@@ -15,9 +15,7 @@
 }))
 
 ; unpack list for function
-(fun {unpack f l} {
-    eval (join (list f) l)
-})
+(def {unpack} apply)
 
 ; pack list for function
 (fun {pack f & xs} {f xs})
@@ -26,18 +24,6 @@
 (def {curry} unpack)
 (def {uncurry} pack)
 
-; perform several things in sequence
-(fun {do & l} {
-    if (== l nil)
-        {nil}
-        {last l}
-})
-
-; open new scope
-(fun {let b} {
-    ((\ {_} b) ())
-})
-
 ;
 ; logical functions
 ;
@@ -4,7 +4,9 @@
 #include "types.h"
 #include "eval.h"
 #include "parser.h"
+#include "reader.h"
 #include "builtin.h"
+#include "infer.h"
 
 #define LASSERT(args, cond, fmt, ...) \
     if (!(cond)) { lval* err = lval_err(fmt, ##__VA_ARGS__); lval_del(args); return err; }
@@ -24,7 +26,6 @@
             "function '%s' passed {} for argument %i", func, index)
 
 
-
 void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
     lval* k = lval_sym(name);
     lval* v = lval_fun(func);
@@ -32,39 +33,85 @@ void lenv_add_builtin(lenv* e, char* name, lbuiltin func) {
     lval_del(k); lval_del(v);
 }
 
+/**
+ * every builtin by name. also used to find builtins again when values
+ * are written out and read back in
+ */
+static struct {
+    char* name;
+    lbuiltin func;
+} builtins[] = {
+    { "list", builtin_list },
+    { "head", builtin_head },
+    { "tail", builtin_tail },
+    { "eval", builtin_eval },
+    { "apply", builtin_apply },
+    { "join", builtin_join },
+    { "do", builtin_do },
+    { "begin", builtin_do },
+
+    { "\\", builtin_lambda },
+    { "def", builtin_def },
+    { "=", builtin_put },
+    { "set!", builtin_set },
+    { "let", builtin_let },
+
+    { "if", builtin_if },
+    { "==", builtin_eq },
+    { "!=", builtin_ne },
+    { ">", builtin_gt },
+    { "<", builtin_lt },
+    { ">=", builtin_ge },
+    { "<=", builtin_le },
+
+    { "while", builtin_while },
+    { "dotimes", builtin_dotimes },
+    { "for-each", builtin_foreach },
+
+    { "+", builtin_add },
+    { "-", builtin_sub },
+    { "*", builtin_mul },
+    { "/", builtin_div },
+
+    { "load", builtin_load },
+    { "print", builtin_print },
+    { "error", builtin_error },
+
+    { "mem", builtin_mem },
+    { NULL, NULL }
+};
+
 void lenv_add_builtins(lenv* e) {
-    lenv_add_builtin(e, "list", builtin_list);
-    lenv_add_builtin(e, "head", builtin_head);
-    lenv_add_builtin(e, "tail", builtin_tail);
-    lenv_add_builtin(e, "eval", builtin_eval);
-    lenv_add_builtin(e, "join", builtin_join);
-
-    lenv_add_builtin(e, "\\",  builtin_lambda);
-    lenv_add_builtin(e, "def", builtin_def);
-    lenv_add_builtin(e, "=",   builtin_put);
-
-    lenv_add_builtin(e, "if", builtin_if);
-    lenv_add_builtin(e, "==", builtin_eq);
-    lenv_add_builtin(e, "!=", builtin_ne);
-    lenv_add_builtin(e, ">", builtin_gt);
-    lenv_add_builtin(e, "<", builtin_lt);
-    lenv_add_builtin(e, ">=", builtin_ge);
-    lenv_add_builtin(e, "<=", builtin_le);
-
-    lenv_add_builtin(e, "+", builtin_add);
-    lenv_add_builtin(e, "-", builtin_sub);
-    lenv_add_builtin(e, "*", builtin_mul);
-    lenv_add_builtin(e, "/", builtin_div);
-
-    lenv_add_builtin(e, "load", builtin_load);
-    lenv_add_builtin(e, "print", builtin_print);
-    lenv_add_builtin(e, "error", builtin_error);
+    for (int i=0; builtins[i].name; i++) {
+        lenv_add_builtin(e, builtins[i].name, builtins[i].func);
+    }
+}
+
+/**
+ * name a builtin is registered under, or NULL
+ */
+char* builtin_name(lbuiltin func) {
+    for (int i=0; builtins[i].name; i++) {
+        if (builtins[i].func == func) { return builtins[i].name; }
+    }
+    return NULL;
+}
+
+/**
+ * builtin registered under name, or NULL
+ */
+lbuiltin builtin_find(char* name) {
+    for (int i=0; builtins[i].name; i++) {
+        if (strcmp(builtins[i].name, name) == 0) { return builtins[i].func; }
+    }
+    return NULL;
 }
 
 /**
  * perform calulations based on operator
  */
 lval* builtin_op(lenv* e, lval* a, char* op) {
+    LASSERT(a, a->count != 0, "function '%s' passed no arguments", op);
     for (int i=0; i < a->count; i++) {
         LASSERT_TYPE(op, a, i, LVAL_NUM);
     }
@@ -83,7 +130,7 @@ lval* builtin_op(lenv* e, lval* a, char* op) {
             if (y->num == 0) {
                 lval_del(x);
                 lval_del(y);
-                x = lval_err("division by zero");
+                x = lval_err_code(LERR_DIV_ZERO);
                 break;
             }
             x->num /= y->num;
@@ -118,6 +165,106 @@ lval* builtin_if(lenv* e, lval* a) {
     return x;
 }
 
+/**
+ * (while {cond} {body}). all iterations share one scope frame
+ */
+lval* builtin_while(lenv* e, lval* a) {
+    LASSERT_NUM("while", a, 2);
+    LASSERT_TYPE("while", a, 0, LVAL_QEXPR);
+    LASSERT_TYPE("while", a, 1, LVAL_QEXPR);
+
+    lenv* f = lenv_push(e);
+    lval* x = lval_sexpr();
+    while (1) {
+        lval* c = lval_eval_body(f, a->cell[0]);
+        if (c->type != LVAL_NUM) {
+            lval_del(x);
+            x = c->type == LVAL_ERR ? c : lval_err(
+                    "function 'while' condition must be %s, got %s",
+                    ltype_name(LVAL_NUM), ltype_name(c->type));
+            if (x != c) { lval_del(c); }
+            break;
+        }
+        int go = c->num != 0;
+        lval_del(c);
+        if (!go) { break; }
+
+        lval_del(x);
+        x = lval_eval_body(f, a->cell[1]);
+        if (x->type == LVAL_ERR) { break; }
+    }
+    lenv_pop(f);
+    lval_del(a);
+    return x;
+}
+
+/**
+ * (dotimes {i} n {body}) binds i to 0 .. n-1 in turn. the counter is
+ * updated in place within a single scope frame
+ */
+lval* builtin_dotimes(lenv* e, lval* a) {
+    LASSERT_NUM("dotimes", a, 3);
+    LASSERT_TYPE("dotimes", a, 0, LVAL_QEXPR);
+    LASSERT_TYPE("dotimes", a, 1, LVAL_NUM);
+    LASSERT_TYPE("dotimes", a, 2, LVAL_QEXPR);
+    LASSERT(a, (a->cell[0]->count == 1 && a->cell[0]->cell[0]->type == LVAL_SYM),
+            "function 'dotimes' expects a single symbol to bind");
+
+    lval* sym = a->cell[0]->cell[0];
+    long n = a->cell[1]->num;
+
+    /* the frame is fresh, so the counter lives in slot 0 */
+    lenv* f = lenv_push(e);
+    lval* k = lval_num(0);
+    lenv_put(f, sym, k);
+    lval_del(k);
+
+    lval* x = lval_sexpr();
+    for (long i=0; i < n; i++) {
+        if (f->vals[0]->type == LVAL_NUM) {
+            f->vals[0]->num = i;
+        } else {
+            lval_del(f->vals[0]);
+            f->vals[0] = lval_num(i);
+        }
+
+        lval_del(x);
+        x = lval_eval_body(f, a->cell[2]);
+        if (x->type == LVAL_ERR) { break; }
+    }
+    lenv_pop(f);
+    lval_del(a);
+    return x;
+}
+
+/**
+ * (for-each {x} list {body}) binds x to each element of list in turn
+ */
+lval* builtin_foreach(lenv* e, lval* a) {
+    LASSERT_NUM("for-each", a, 3);
+    LASSERT_TYPE("for-each", a, 0, LVAL_QEXPR);
+    LASSERT_TYPE("for-each", a, 1, LVAL_QEXPR);
+    LASSERT_TYPE("for-each", a, 2, LVAL_QEXPR);
+    LASSERT(a, (a->cell[0]->count == 1 && a->cell[0]->cell[0]->type == LVAL_SYM),
+            "function 'for-each' expects a single symbol to bind");
+
+    lval* sym = a->cell[0]->cell[0];
+    lval* l = a->cell[1];
+
+    lenv* f = lenv_push(e);
+    lval* x = lval_sexpr();
+    for (int i=0; i < l->count; i++) {
+        lenv_put(f, sym, l->cell[i]);
+
+        lval_del(x);
+        x = lval_eval_body(f, a->cell[2]);
+        if (x->type == LVAL_ERR) { break; }
+    }
+    lenv_pop(f);
+    lval_del(a);
+    return x;
+}
+
 lval* builtin_ord(lenv* e, lval* a, char* op) {
     LASSERT_NUM(op, a, 2);
     LASSERT_TYPE(op, a, 0, LVAL_NUM);
@@ -195,7 +342,32 @@ lval* builtin_eval(lenv* e, lval* a) {
     return lval_eval(e, x);
 }
 
+/**
+ * call function with the elements of a list as its arguments. the list is
+ * handed over as is; its elements are not evaluated again
+ */
+lval* builtin_apply(lenv* e, lval* a) {
+    LASSERT_NUM("apply", a, 2);
+    LASSERT_TYPE("apply", a, 0, LVAL_FUN);
+    LASSERT_TYPE("apply", a, 1, LVAL_QEXPR);
+
+    lval* f = lval_pop(a, 0);
+    lval* args = lval_take(a, 0);
+    args->type = LVAL_SEXPR;
+
+    /* like (f) on its own, nothing to apply f to gives back f */
+    if (args->count == 0) {
+        lval_del(args);
+        return f;
+    }
+
+    lval* x = lval_call(e, f, args);
+    lval_del(f);
+    return x;
+}
+
 lval* builtin_join(lenv* e, lval* a) {
+    LASSERT(a, a->count != 0, "function 'join' passed no arguments");
     for (int i=0; i < a->count; i++) {
         LASSERT_TYPE("join", a, i, LVAL_QEXPR);
     }
@@ -207,6 +379,18 @@ lval* builtin_join(lenv* e, lval* a) {
     return x;
 }
 
+/**
+ * arguments have already been evaluated in order by the time we get here,
+ * so sequencing is just handing back the last one
+ */
+lval* builtin_do(lenv* e, lval* a) {
+    if (a->count == 0) {
+        a->type = LVAL_QEXPR;
+        return a;
+    }
+    return lval_take(a, a->count-1);
+}
+
 lval* builtin_def(lenv* e, lval* a) {
     return builtin_var(e, a, "def");
 }
@@ -241,41 +425,159 @@ lval* builtin_var(lenv* e, lval* a, char* func) {
     return lval_sexpr();
 }
 
+/**
+ * assign to existing variables, wherever they are bound. values are moved
+ * into their slots rather than copied
+ */
+lval* builtin_set(lenv* e, lval* a) {
+    LASSERT_TYPE("set!", a, 0, LVAL_QEXPR);
+
+    lval* syms = a->cell[0];
+    for (int i=0; i<syms->count; i++) {
+        LASSERT(a, (syms->cell[i]->type == LVAL_SYM),
+                "function 'set!' cannot set non-symbol. expected %s, got %s",
+                ltype_name(LVAL_SYM), ltype_name(syms->cell[i]->type));
+    }
+    LASSERT(a, (syms->count == a->count-1),
+            "function 'set!' passed too many arguments for symbols. expected %i, got %i",
+            a->count-1, syms->count);
+
+    for (int i=0; i < syms->count; i++) {
+        if (!lenv_set(e, syms->cell[i], lval_pop(a, 1))) {
+            lval* err = lval_err("function 'set!' cannot set unbound symbol %s",
+                    syms->cell[i]->sym);
+            lval_del(a);
+            return err;
+        }
+    }
+    lval_del(a);
+    return lval_sexpr();
+}
+
 lval* builtin_lambda(lenv* e, lval* a) {
     LASSERT_NUM("\\", a, 2);
     LASSERT_TYPE("\\", a, 0, LVAL_QEXPR);
     LASSERT_TYPE("\\", a, 1, LVAL_QEXPR);
 
-    for (int i=0; i < a->cell[0]->count; i++) {
-        LASSERT(a, (a->cell[0]->cell[i]->type == LVAL_SYM),
+    lval* syms = a->cell[0];
+    for (int i=0; i < syms->count; i++) {
+        LASSERT(a, (syms->cell[i]->type == LVAL_SYM),
             "cannot define non-symbol. expected %s, got %s",
-            ltype_name(LVAL_SYM), ltype_name(a->cell[0]->cell[i]->type));
+            ltype_name(LVAL_SYM), ltype_name(syms->cell[i]->type));
+        for (int j=0; j < i; j++) {
+            LASSERT(a, (strcmp(syms->cell[i]->sym, syms->cell[j]->sym) != 0),
+                "cannot bind symbol %s twice", syms->cell[i]->sym);
+        }
     }
     lval* formals = lval_pop(a, 0);
     lval* body = lval_pop(a, 0);
     lval_del(a);
-    return lval_lambda(formals, body);
+
+    lval* f = lval_lambda(formals, body);
+    f->body->numeric = lval_infer_numeric(f);
+    return f;
+}
+
+/**
+ * evaluate body in a new scope. takes either just the body, or a list of
+ * alternating symbols and expressions to bind first, e.g.
+ * (let {x 1 y (+ x 1)} {* x y}). bindings are evaluated in order, each one
+ * seeing the ones before it.
+ */
+lval* builtin_let(lenv* e, lval* a) {
+    LASSERT(a, (a->count == 1 || a->count == 2),
+            "function 'let' passed incorrect number of arguments. expected 1 or 2, got %i",
+            a->count);
+    for (int i=0; i < a->count; i++) {
+        LASSERT_TYPE("let", a, i, LVAL_QEXPR);
+    }
+
+    if (a->count == 2) {
+        lval* binds = a->cell[0];
+        LASSERT(a, (binds->count % 2 == 0),
+                "function 'let' passed odd number of binding forms");
+        for (int i=0; i < binds->count; i += 2) {
+            LASSERT(a, (binds->cell[i]->type == LVAL_SYM),
+                    "function 'let' cannot bind non-symbol. expected %s, got %s",
+                    ltype_name(LVAL_SYM), ltype_name(binds->cell[i]->type));
+        }
+    }
+
+    lenv* f = lenv_push(e);
+
+    if (a->count == 2) {
+        lval* binds = lval_pop(a, 0);
+        while (binds->count) {
+            lval* sym = lval_pop(binds, 0);
+            lval* val = lval_eval(f, lval_pop(binds, 0));
+            if (val->type == LVAL_ERR) {
+                lval_del(sym); lval_del(binds); lval_del(a);
+                lenv_pop(f);
+                return val;
+            }
+            lenv_put(f, sym, val);
+            lval_del(sym); lval_del(val);
+        }
+        lval_del(binds);
+    }
+
+    lval* body = lval_take(a, 0);
+    body->type = LVAL_SEXPR;
+    lval* x = lval_eval(f, body);
+    lenv_pop(f);
+    return x;
 }
 
 lval* builtin_load(lenv* e, lval* a) {
     LASSERT_NUM("load", a, 1);
     LASSERT_TYPE("load", a, 0, LVAL_STR);
 
-    lval* expr = lval_read_file(a->cell[0]->str);
+    /* the native reader hands over forms as it reads them; the mpc
+     * readers need the whole file first */
+    char* filename = a->cell[0]->str;
+    lstream* s = NULL;
+    lval* expr = NULL;
+    if (parser_reader == READER_NATIVE) {
+        s = lstream_open(filename);
+        if (!s) {
+            lval* err = lval_err("could not load library %s", filename);
+            lval_del(a);
+            return err;
+        }
+    } else {
+        expr = lval_read_file(filename);
+        if (expr->type == LVAL_ERR) {
+            lval_del(a);
+            return expr;
+        }
+    }
 
-    if (expr->type != LVAL_ERR) {
-        while (expr->count) {
-            lval* x = lval_eval(e, lval_pop(expr, 0));
+    lval* result = NULL;
+    lval* err = NULL;
+    while (1) {
+        lval* form = s
+            ? lstream_next(s, &err)
+            : (expr->count ? lval_pop(expr, 0) : NULL);
+        if (!form) { break; }
 
-            if (x->type == LVAL_ERR) { lval_println(x); }
-            lval_del(x);
+        lval* x = lval_eval(e, form);
+
+        /* an exhausted budget aborts the whole load */
+        if (x->type == LVAL_ERR && lbudget_exceeded()) {
+            result = x;
+            break;
         }
-        lval_del(expr); lval_del(a);
-        return lval_sexpr();
-    } else {
-        lval_del(a);
-        return expr;
+        if (x->type == LVAL_ERR) { lval_println(x); }
+        lval_del(x);
     }
+
+    if (err) {
+        result = lval_err("could not load library %s", err->err);
+        lval_del(err);
+    }
+    if (s) { lstream_close(s); } else { lval_del(expr); }
+    lval_del(a);
+    return result ? result : lval_sexpr();
 }
 
 lval* builtin_print(lenv* e, lval* a) {
@@ -292,7 +594,31 @@ lval* builtin_error(lenv* e, lval* a) {
     LASSERT_NUM("error", a, 1);
     LASSERT_TYPE("error", a, 0, LVAL_STR);
 
-    lval* err =lval_err(a->cell[0]->str);
+    lval* err = lval_err("%s", a->cell[0]->str);
     lval_del(a);
     return err;
 }
+
+/**
+ * (mem "current"), (mem "peak") or (mem "quota"); bytes held by values and
+ * environments
+ */
+lval* builtin_mem(lenv* e, lval* a) {
+    LASSERT_NUM("mem", a, 1);
+    LASSERT_TYPE("mem", a, 0, LVAL_STR);
+
+    char* which = a->cell[0]->str;
+    lval* x;
+    if (strcmp(which, "current") == 0) {
+        x = lval_num(lmem_current());
+    } else if (strcmp(which, "peak") == 0) {
+        x = lval_num(lmem_max());
+    } else if (strcmp(which, "quota") == 0) {
+        x = lval_num(lmem_quota());
+    } else {
+        x = lval_err("function 'mem' expects \"current\", \"peak\" or \"quota\", got \"%s\"",
+                which);
+    }
+    lval_del(a);
+    return x;
+}
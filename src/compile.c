@@ -0,0 +1,759 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "parser.h"
+#include "builtin.h"
+#include "infer.h"
+#include "compile.h"
+#include "shake.h"
+
+/**
+ * ahead-of-time translation to c
+ *
+ * the part of the global environment the script can reach, as it stands
+ * after the prelude has been evaluated, is written out as constructor
+ * calls that rebuild each binding directly. the forms of the script
+ * itself are written out the same way and evaluated in order by the
+ * generated main, so the result needs neither the parser nor the prelude
+ * at run time.
+ *
+ * lambdas that infer.c finds numeric are also written out as c functions
+ * on longs, see below. everything else is still run by the evaluator.
+ */
+
+static void emit_long(FILE* out, long x) {
+    /* -9223372036854775808L is the negation of a literal too big for long */
+    if (x == LONG_MIN) {
+        fputs("LONG_MIN", out);
+    } else {
+        fprintf(out, "%liL", x);
+    }
+}
+
+static void emit_string(FILE* out, char* s) {
+    putc('"', out);
+    for (unsigned char* c = (unsigned char*)s; *c; c++) {
+        if (*c == '"' || *c == '\\' || *c == '?') {
+            fprintf(out, "\\%c", *c);
+        } else if (*c < 32 || *c > 126) {
+            fprintf(out, "\\%03o", *c);
+        } else {
+            putc(*c, out);
+        }
+    }
+    putc('"', out);
+}
+
+static void emit_val(FILE* out, lval* v);
+
+static void emit_cells(FILE* out, lval* v, char* ctor) {
+    if (v->count == 0) {
+        fprintf(out, "%s()", ctor);
+        return;
+    }
+    fprintf(out, "list(%s(), %i", ctor, v->count);
+    for (int i=0; i < v->count; i++) {
+        fputs(", ", out);
+        emit_val(out, v->cell[i]);
+    }
+    putc(')', out);
+}
+
+static void emit_lambda(FILE* out, lval* v) {
+    /* bindings from partial application wrap the lambda itself */
+    for (int i=0; i < v->env->count; i++) {
+        fputs("partial(", out);
+    }
+    fputs("lambda(", out);
+    emit_val(out, v->formals);
+    fputs(", ", out);
+    emit_val(out, v->body);
+    putc(')', out);
+    for (int i=0; i < v->env->count; i++) {
+        fputs(", ", out);
+        emit_string(out, v->env->syms[i]);
+        fputs(", ", out);
+        emit_val(out, v->env->vals[i]);
+        putc(')', out);
+    }
+}
+
+static void emit_val(FILE* out, lval* v) {
+    switch (v->type) {
+        case LVAL_NUM: fputs("lval_num(", out);
+                       emit_long(out, v->num); putc(')', out); break;
+        case LVAL_ERR: fputs("lval_err(\"%s\", ", out);
+                       emit_string(out, v->err); putc(')', out); break;
+        case LVAL_SYM: fputs("lval_sym(", out);
+                       emit_string(out, v->sym); putc(')', out); break;
+        case LVAL_STR: fputs("lval_str(", out);
+                       emit_string(out, v->str); putc(')', out); break;
+        case LVAL_SEXPR: emit_cells(out, v, "lval_sexpr"); break;
+        case LVAL_QEXPR: emit_cells(out, v, "lval_qexpr"); break;
+        case LVAL_FUN:
+            if (v->builtin) {
+                fputs("lval_fun(builtin_find(", out);
+                emit_string(out, builtin_name(v->builtin));
+                fputs("))", out);
+            } else {
+                emit_lambda(out, v);
+            }
+            break;
+    }
+}
+
+/**
+ * numeric lambdas
+ *
+ * lambdas that infer.c finds numeric are written out as c functions on
+ * longs as well, as long as every operator in them is, as far as can be
+ * told here, arithmetic, a comparison, if or another such lambda. calls
+ * between these go straight from c to c. the lambdas looked at are the
+ * reachable globals and those the script defines with a plain
+ * (def {name} (\ {...} {...})) at top level.
+ *
+ * with dynamic scope the operators are only really known at call time.
+ * the body of the lambda gets an entry, called by lval_call_numeric,
+ * that first checks that they all still resolve the same way. if they do,
+ * nothing run from there can bind anything, so the check holds for the
+ * whole call. if not, the entry gives up and the call is run as before.
+ * formals of a lambda shadow operators of the lambdas it calls, so those
+ * must not share names. a call to one counts as a single evaluation step.
+ */
+
+typedef struct {
+    lenv* scope;    /* lambdas looked at, in front of the globals */
+    int* global;    /* index of each in the globals, or -1 */
+    int* form;      /* index of the form defining each, or -1 */
+    int* native;    /* each is written out as c */
+} natives;
+
+static int is_arith(lbuiltin b) {
+    return b == builtin_add || b == builtin_sub ||
+        b == builtin_mul || b == builtin_div;
+}
+
+static char* cmp_op(lbuiltin b) {
+    if (b == builtin_gt) { return ">"; }
+    if (b == builtin_lt) { return "<"; }
+    if (b == builtin_ge) { return ">="; }
+    if (b == builtin_le) { return "<="; }
+    if (b == builtin_eq) { return "=="; }
+    if (b == builtin_ne) { return "!="; }
+    return NULL;
+}
+
+static int formal_index(lval* formals, char* sym) {
+    for (int i=0; i < formals->count; i++) {
+        if (strcmp(formals->cell[i]->sym, sym) == 0) { return i; }
+    }
+    return -1;
+}
+
+/**
+ * index of the lambda bound to sym in the scope, or -1
+ */
+static int native_index(natives* n, char* sym) {
+    lenv* s = n->scope;
+    for (int i=0; i < s->count; i++) {
+        if (strcmp(s->syms[i], sym) == 0) { return i; }
+    }
+    return -1;
+}
+
+/**
+ * function an operator is bound to as far as can be told here, or NULL
+ */
+static lval* native_fun(natives* n, char* sym) {
+    lval* v = lenv_lookup(n->scope, sym);
+    return (v && v->type == LVAL_FUN) ? v : NULL;
+}
+
+/**
+ * the lambda in a top-level (def {name} (\ {...} {...})), or NULL
+ */
+static lval* def_lambda(lval* x) {
+    if (x->type != LVAL_SEXPR || x->count != 3) { return NULL; }
+    lval** c = x->cell;
+    if (c[0]->type != LVAL_SYM || strcmp(c[0]->sym, "def") != 0 ||
+            c[1]->type != LVAL_QEXPR || c[1]->count != 1 ||
+            c[1]->cell[0]->type != LVAL_SYM ||
+            c[2]->type != LVAL_SEXPR || c[2]->count != 3) {
+        return NULL;
+    }
+
+    lval** l = c[2]->cell;
+    if (l[0]->type != LVAL_SYM || strcmp(l[0]->sym, "\\") != 0 ||
+            l[1]->type != LVAL_QEXPR || l[2]->type != LVAL_QEXPR) {
+        return NULL;
+    }
+    for (int i=0; i < l[1]->count; i++) {
+        if (l[1]->cell[i]->type != LVAL_SYM) { return NULL; }
+        if (formal_index(l[1], l[1]->cell[i]->sym) != i) { return NULL; }
+    }
+    return c[2];
+}
+
+static int native_expr(natives* n, lval* formals, lval* x);
+
+/**
+ * whether the call x, in a lambda with these formals, can be written as c
+ */
+static int native_call(natives* n, lval* formals, lval* x) {
+    if (x->count == 0) { return 0; }
+    if (x->count == 1) { return native_expr(n, formals, x->cell[0]); }
+    if (x->cell[0]->type != LVAL_SYM) { return 0; }
+
+    lval* f = native_fun(n, x->cell[0]->sym);
+    if (!f) { return 0; }
+
+    int argc = x->count - 1;
+    if (f->builtin == builtin_if) {
+        return argc == 3 &&
+            x->cell[2]->type == LVAL_QEXPR && x->cell[3]->type == LVAL_QEXPR &&
+            native_expr(n, formals, x->cell[1]) &&
+            native_call(n, formals, x->cell[2]) &&
+            native_call(n, formals, x->cell[3]);
+    }
+    if (f->builtin) {
+        if (!is_arith(f->builtin) && !(cmp_op(f->builtin) && argc == 2)) {
+            return 0;
+        }
+    } else {
+        int j = native_index(n, x->cell[0]->sym);
+        if (j < 0 || !n->native[j] || f->arity != argc) { return 0; }
+    }
+
+    for (int i=1; i < x->count; i++) {
+        if (!native_expr(n, formals, x->cell[i])) { return 0; }
+    }
+    return 1;
+}
+
+static int native_expr(natives* n, lval* formals, lval* x) {
+    switch (x->type) {
+        case LVAL_NUM: return 1;
+        case LVAL_SYM: return formal_index(formals, x->sym) >= 0;
+        case LVAL_SEXPR: return native_call(n, formals, x);
+        default: return 0;
+    }
+}
+
+/**
+ * add the operators x uses to ops, along with those of every lambda it
+ * calls that is written out as c
+ */
+static void native_ops(natives* n, lval* x, lval* ops, int* seen) {
+    if (x->type != LVAL_SEXPR && x->type != LVAL_QEXPR) { return; }
+
+    if (x->count > 1 && x->cell[0]->type == LVAL_SYM) {
+        char* sym = x->cell[0]->sym;
+        if (!shake_has(ops, sym)) { lval_add(ops, lval_sym(sym)); }
+
+        int j = native_index(n, sym);
+        if (j >= 0 && n->native[j] && !seen[j]) {
+            seen[j] = 1;
+            native_ops(n, n->scope->vals[j]->body, ops, seen);
+        }
+    }
+    for (int i=0; i < x->count; i++) {
+        native_ops(n, x->cell[i], ops, seen);
+    }
+}
+
+/**
+ * operators that calling lambda i can reach
+ */
+static lval* native_reach(natives* n, int i) {
+    int* seen = calloc(n->scope->count, sizeof(int));
+    seen[i] = 1;
+    lval* ops = lval_qexpr();
+    native_ops(n, n->scope->vals[i]->body, ops, seen);
+    free(seen);
+    return ops;
+}
+
+static void native_add(natives* n, char* sym, lval* f, int global, int form) {
+    int i = n->scope->count;
+    lenv_bind(n->scope, sym, f);
+    n->global[i] = global;
+    n->form[i] = form;
+    n->native[i] = f->env->count == 0 && !f->variadic &&
+        f->arity <= INFER_MAX_ARGS && lval_infer_numeric(f);
+}
+
+/**
+ * find the lambdas among the reachable globals in e and the definitions
+ * in forms that can be written out as c
+ */
+static natives* native_find(lenv* e, lval* used, lval* forms) {
+    natives* n = malloc(sizeof(natives));
+    n->scope = lenv_new();
+    n->scope->par = e;
+    int max = e->count + forms->count;
+    n->global = malloc(sizeof(int) * max);
+    n->form = malloc(sizeof(int) * max);
+    n->native = malloc(sizeof(int) * max);
+
+    for (int i=0; i < forms->count; i++) {
+        lval* l = def_lambda(forms->cell[i]);
+        if (!l) { continue; }
+        char* sym = forms->cell[i]->cell[1]->cell[0]->sym;
+
+        /* defined more than once; which one a call meets is not known */
+        int j = native_index(n, sym);
+        if (j >= 0) {
+            n->native[j] = 0;
+            continue;
+        }
+        lval* f = lval_lambda(lval_copy(l->cell[1]), lval_copy(l->cell[2]));
+        native_add(n, sym, f, -1, i);
+    }
+
+    /* the script's own definitions hide globals of the same name */
+    for (int i=0; i < e->count; i++) {
+        lval* f = e->vals[i];
+        if (!shake_has(used, e->syms[i]) || native_index(n, e->syms[i]) >= 0 ||
+                f->type != LVAL_FUN || f->builtin) {
+            continue;
+        }
+        native_add(n, e->syms[i], lval_copy(f), i, -1);
+    }
+
+    /* drop lambdas calling ones just dropped until none are left */
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i=0; i < n->scope->count; i++) {
+            if (!n->native[i]) { continue; }
+            lval* f = n->scope->vals[i];
+
+            int ok = native_call(n, f->formals, f->body);
+            lval* ops = native_reach(n, i);
+            for (int k=0; ok && k < f->formals->count; k++) {
+                ok = !shake_has(ops, f->formals->cell[k]->sym);
+            }
+            lval_del(ops);
+
+            if (!ok) {
+                n->native[i] = 0;
+                changed = 1;
+            }
+        }
+    }
+    return n;
+}
+
+/**
+ * lambda written out for global i or the definition in form i, or -1
+ */
+static int native_of_global(natives* n, int i) {
+    for (int j=0; j < n->scope->count; j++) {
+        if (n->global[j] == i) { return n->native[j] ? j : -1; }
+    }
+    return -1;
+}
+
+static int native_of_form(natives* n, int i) {
+    for (int j=0; j < n->scope->count; j++) {
+        if (n->form[j] == i) { return n->native[j] ? j : -1; }
+    }
+    return -1;
+}
+
+static void native_free(natives* n) {
+    n->scope->par = NULL;
+    lenv_del(n->scope);
+    free(n->global);
+    free(n->form);
+    free(n->native);
+    free(n);
+}
+
+static void emit_indent(FILE* out, int depth) {
+    fprintf(out, "%*s", depth * 4, "");
+}
+
+static int emit_num_call(FILE* out, natives* n, lval* formals, lval* x,
+        int* next, int depth);
+
+/**
+ * write statements computing x into a new temporary, and return its number
+ */
+static int emit_num(FILE* out, natives* n, lval* formals, lval* x,
+        int* next, int depth) {
+    if (x->type == LVAL_SEXPR) {
+        return emit_num_call(out, n, formals, x, next, depth);
+    }
+
+    int t = (*next)++;
+    emit_indent(out, depth);
+    fprintf(out, "long t%i = ", t);
+    if (x->type == LVAL_NUM) {
+        emit_long(out, x->num);
+    } else {
+        fprintf(out, "a%i", formal_index(formals, x->sym));
+    }
+    fputs(";\n", out);
+    return t;
+}
+
+static int emit_num_call(FILE* out, natives* n, lval* formals, lval* x,
+        int* next, int depth) {
+    if (x->count == 1) {
+        return emit_num(out, n, formals, x->cell[0], next, depth);
+    }
+
+    char* sym = x->cell[0]->sym;
+    lval* f = native_fun(n, sym);
+    int t;
+
+    if (f->builtin == builtin_if) {
+        int c = emit_num(out, n, formals, x->cell[1], next, depth);
+        t = (*next)++;
+        emit_indent(out, depth);
+        fprintf(out, "long t%i;\n", t);
+        for (int i=2; i < 4; i++) {
+            emit_indent(out, depth);
+            if (i == 2) {
+                fprintf(out, "if (t%i) {\n", c);
+            } else {
+                fputs("} else {\n", out);
+            }
+            int r = emit_num_call(out, n, formals, x->cell[i], next, depth+1);
+            emit_indent(out, depth+1);
+            fprintf(out, "t%i = t%i;\n", t, r);
+        }
+        emit_indent(out, depth);
+        fputs("}\n", out);
+        return t;
+    }
+
+    /* every argument is evaluated before any of them is used */
+    int argc = x->count - 1;
+    int* args = malloc(sizeof(int) * argc);
+    for (int i=0; i < argc; i++) {
+        args[i] = emit_num(out, n, formals, x->cell[i+1], next, depth);
+    }
+
+    t = (*next)++;
+    emit_indent(out, depth);
+    if (!f->builtin) {
+        fprintf(out, "long t%i;\n", t);
+        emit_indent(out, depth);
+        fprintf(out, "if (num_%i(&t%i, err", native_index(n, sym), t);
+        for (int i=0; i < argc; i++) { fprintf(out, ", t%i", args[i]); }
+        fputs(")) { return 1; }\n", out);
+    } else if (cmp_op(f->builtin)) {
+        fprintf(out, "long t%i = t%i %s t%i;\n",
+            t, args[0], cmp_op(f->builtin), args[1]);
+    } else {
+        fprintf(out, "long t%i = t%i;\n", t, args[0]);
+        if (f->builtin == builtin_sub && argc == 1) {
+            emit_indent(out, depth);
+            fprintf(out, "t%i = -t%i;\n", t, t);
+        }
+        for (int i=1; i < argc; i++) {
+            emit_indent(out, depth);
+            if (f->builtin == builtin_add) {
+                fprintf(out, "t%i += t%i;\n", t, args[i]);
+            } else if (f->builtin == builtin_sub) {
+                fprintf(out, "t%i -= t%i;\n", t, args[i]);
+            } else if (f->builtin == builtin_mul) {
+                fprintf(out, "t%i *= t%i;\n", t, args[i]);
+            } else {
+                fprintf(out, "if (t%i == 0) { "
+                    "*err = lval_err_code(LERR_DIV_ZERO); return 1; }\n",
+                    args[i]);
+                emit_indent(out, depth);
+                fprintf(out, "t%i /= t%i;\n", t, args[i]);
+            }
+        }
+    }
+    free(args);
+    return t;
+}
+
+static void emit_num_head(FILE* out, int i, lval* f) {
+    fprintf(out, "static int num_%i(long* out, lval** err", i);
+    for (int k=0; k < f->formals->count; k++) {
+        fprintf(out, ", long a%i", k);
+    }
+    putc(')', out);
+}
+
+/**
+ * index of the builtin named name in names, adding it if it is not there
+ */
+static int op_index(lval* names, char* name) {
+    for (int i=0; i < names->count; i++) {
+        if (strcmp(names->cell[i]->sym, name) == 0) { return i; }
+    }
+    lval_add(names, lval_sym(name));
+    return names->count - 1;
+}
+
+/**
+ * write the c functions for the lambdas in n, and the entries that check
+ * their operators. builtins the checks compare against are looked up
+ * once, by find_ops
+ */
+static void emit_natives(FILE* out, natives* n) {
+    lenv* s = n->scope;
+
+    lval* names = lval_qexpr();
+    for (int i=0; i < s->count; i++) {
+        if (!n->native[i]) { continue; }
+        lval* ops = native_reach(n, i);
+        for (int k=0; k < ops->count; k++) {
+            lval* f = native_fun(n, ops->cell[k]->sym);
+            if (f->builtin) { op_index(names, builtin_name(f->builtin)); }
+        }
+        lval_del(ops);
+    }
+
+    fprintf(out, "static lbuiltin ops[%i];\n\n", names->count + 1);
+    fputs("static void find_ops(void) {\n", out);
+    for (int i=0; i < names->count; i++) {
+        fprintf(out, "    ops[%i] = builtin_find(", i);
+        emit_string(out, names->cell[i]->sym);
+        fputs(");\n", out);
+    }
+    fputs("}\n\n", out);
+
+    for (int i=0; i < s->count; i++) {
+        if (!n->native[i]) { continue; }
+        emit_num_head(out, i, s->vals[i]);
+        fputs(";\n", out);
+        fprintf(out, "static lval* entry_%i(lenv* e, long* a);\n", i);
+    }
+    putc('\n', out);
+
+    for (int i=0; i < s->count; i++) {
+        if (!n->native[i]) { continue; }
+        lval* f = s->vals[i];
+
+        fprintf(out, "/* %s */\n", s->syms[i]);
+        emit_num_head(out, i, f);
+        fputs(" {\n", out);
+        fputs("    lval* stop = lbudget_step();\n", out);
+        fputs("    if (stop) { *err = stop; return 1; }\n", out);
+        int next = 0;
+        int t = emit_num_call(out, n, f->formals, f->body, &next, 1);
+        fprintf(out, "    *out = t%i;\n", t);
+        fputs("    return 0;\n}\n\n", out);
+    }
+
+    for (int i=0; i < s->count; i++) {
+        if (!n->native[i]) { continue; }
+        lval* f = s->vals[i];
+        lval* ops = native_reach(n, i);
+
+        fprintf(out, "static lval* entry_%i(lenv* e, long* a) {\n", i);
+        for (int k=0; k < ops->count; k++) {
+            char* sym = ops->cell[k]->sym;
+            lval* op = native_fun(n, sym);
+            fputs(k == 0 ? "    if (" : " ||\n            ", out);
+            if (op->builtin) {
+                fputs("!has_builtin(e, ", out);
+                emit_string(out, sym);
+                fprintf(out, ", ops[%i])",
+                    op_index(names, builtin_name(op->builtin)));
+            } else {
+                fputs("!has_native(e, ", out);
+                emit_string(out, sym);
+                fprintf(out, ", entry_%i)", native_index(n, sym));
+            }
+        }
+        if (ops->count) { fputs(") {\n        return NULL;\n    }\n", out); }
+        fputs("    long x;\n    lval* err = NULL;\n", out);
+        fprintf(out, "    if (num_%i(&x, &err", i);
+        for (int k=0; k < f->formals->count; k++) {
+            fprintf(out, ", a[%i]", k);
+        }
+        fputs(")) { return err; }\n", out);
+        fputs("    return lval_num(x);\n}\n\n", out);
+        lval_del(ops);
+    }
+    lval_del(names);
+}
+
+static char* prologue =
+    "#include <limits.h>\n"
+    "#include <stdarg.h>\n"
+    "\n"
+    "#include \"types.h\"\n"
+    "#include \"eval.h\"\n"
+    "#include \"builtin.h\"\n"
+    "#include \"infer.h\"\n"
+    "\n"
+    "static lval* list(lval* v, int n, ...) {\n"
+    "    va_list va;\n"
+    "    va_start(va, n);\n"
+    "    for (int i=0; i < n; i++) { lval_add(v, va_arg(va, lval*)); }\n"
+    "    va_end(va);\n"
+    "    return v;\n"
+    "}\n"
+    "\n"
+    "static lval* lambda(lval* formals, lval* body) {\n"
+    "    lval* f = lval_lambda(formals, body);\n"
+    "    f->body->numeric = lval_infer_numeric(f);\n"
+    "    return f;\n"
+    "}\n"
+    "\n"
+    "static lval* partial(lval* f, char* sym, lval* v) {\n"
+    "    lenv_bind(f->env, sym, v);\n"
+    "    return f;\n"
+    "}\n"
+    "\n"
+    "static lval* native(lval* f, lnative entry) {\n"
+    "    f->body->native = entry;\n"
+    "    return f;\n"
+    "}\n"
+    "\n"
+    "static void attach(lenv* e, char* sym, lval* f, lnative entry) {\n"
+    "    lval* v = lenv_lookup(e, sym);\n"
+    "    if (v && v->type == LVAL_FUN && !v->builtin &&\n"
+    "            v->env->count == 0 && lval_eq(v, f)) {\n"
+    "        v->body->native = entry;\n"
+    "    }\n"
+    "    lval_del(f);\n"
+    "}\n"
+    "\n"
+    "static int has_builtin(lenv* e, char* sym, lbuiltin b) {\n"
+    "    lval* v = lenv_lookup(e, sym);\n"
+    "    return v && v->type == LVAL_FUN && v->builtin == b;\n"
+    "}\n"
+    "\n"
+    "static int has_native(lenv* e, char* sym, lnative entry) {\n"
+    "    lval* v = lenv_lookup(e, sym);\n"
+    "    return v && v->type == LVAL_FUN && !v->builtin &&\n"
+    "        v->env->count == 0 && v->body->native == entry;\n"
+    "}\n"
+    "\n"
+    "static void def(lenv* e, char* sym, lval* v) {\n"
+    "    lval* k = lval_sym(sym);\n"
+    "    lenv_put(e, k, v);\n"
+    "    lval_del(k); lval_del(v);\n"
+    "}\n"
+    "\n";
+
+static char* epilogue =
+    "int main(void) {\n"
+    "    (void)list; (void)lambda; (void)partial; (void)native;\n"
+    "    (void)attach; (void)has_builtin; (void)has_native; (void)def;\n"
+    "    (void)ops;\n"
+    "\n"
+    "    lenv* e = lenv_new();\n"
+    "    lenv_add_builtins(e);\n"
+    "    define_globals(e);\n"
+    "\n"
+    "    for (int i=0; forms[i]; i++) {\n"
+    "        lval* x = lval_eval(e, forms[i]());\n"
+    "        if (x->type == LVAL_ERR) { lval_println(x); }\n"
+    "        lval_del(x);\n"
+    "        if (after[i]) { after[i](e); }\n"
+    "    }\n"
+    "\n"
+    "    lenv_del(e);\n"
+    "    return 0;\n"
+    "}\n";
+
+/**
+ * write c for the reachable bindings in e that are not plain builtins,
+ * followed by the top-level forms of each file
+ */
+lval* compile_c(lenv* e, char* outfile, int nfiles, char** files) {
+    lval* forms = lval_sexpr();
+    for (int i=0; i < nfiles; i++) {
+        lval* x = lval_read_file(files[i]);
+        if (x->type == LVAL_ERR) {
+            lval_del(forms);
+            return x;
+        }
+        forms = lval_join(forms, x);
+    }
+
+    FILE* out = fopen(outfile, "w");
+    if (!out) {
+        lval_del(forms);
+        return lval_err("could not open %s for writing", outfile);
+    }
+
+    fputs("/* generated by lispy --emit-c */\n\n", out);
+    fputs(prologue, out);
+
+    /* only what the script can reach */
+    lval* used = shake_env(e, forms);
+
+    natives* n = native_find(e, used, forms);
+    emit_natives(out, n);
+
+    fputs("static void define_globals(lenv* e) {\n", out);
+    fputs("    find_ops();\n", out);
+    for (int i=0; i < e->count; i++) {
+        lval* v = e->vals[i];
+        if (!shake_has(used, e->syms[i])) { continue; }
+        if (v->type == LVAL_FUN && v->builtin &&
+                builtin_find(e->syms[i]) == v->builtin) {
+            continue;
+        }
+        fputs("    def(e, ", out);
+        emit_string(out, e->syms[i]);
+        fputs(", ", out);
+        int j = native_of_global(n, i);
+        if (j >= 0) {
+            fputs("native(", out);
+            emit_val(out, v);
+            fprintf(out, ", entry_%i)", j);
+        } else {
+            emit_val(out, v);
+        }
+        fputs(");\n", out);
+    }
+    fputs("}\n\n", out);
+
+    for (int i=0; i < forms->count; i++) {
+        fprintf(out, "static lval* form_%i(void) {\n    return ", i);
+        emit_val(out, forms->cell[i]);
+        fputs(";\n}\n\n", out);
+    }
+
+    fputs("static lval* (*forms[])(void) = {\n", out);
+    for (int i=0; i < forms->count; i++) {
+        fprintf(out, "    form_%i,\n", i);
+    }
+    fputs("    NULL\n};\n\n", out);
+
+    /* definitions the script makes get their c once they have run */
+    for (int i=0; i < forms->count; i++) {
+        int j = native_of_form(n, i);
+        if (j < 0) { continue; }
+        fprintf(out, "static void after_%i(lenv* e) {\n    attach(e, ", i);
+        emit_string(out, n->scope->syms[j]);
+        fputs(", ", out);
+        emit_val(out, n->scope->vals[j]);
+        fprintf(out, ", entry_%i);\n}\n\n", j);
+    }
+
+    fputs("static void (*after[])(lenv* e) = {\n", out);
+    for (int i=0; i < forms->count; i++) {
+        if (native_of_form(n, i) >= 0) {
+            fprintf(out, "    after_%i,\n", i);
+        } else {
+            fputs("    NULL,\n", out);
+        }
+    }
+    fputs("    NULL\n};\n\n", out);
+
+    fputs(epilogue, out);
+
+    fclose(out);
+    native_free(n);
+    lval_del(used);
+    lval_del(forms);
+    return lval_sexpr();
+}
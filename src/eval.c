@@ -1,22 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <signal.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "eval.h"
 #include "types.h"
 #include "builtin.h"
+#include "infer.h"
 
 /**
- * evaluate s-expression
+ * evaluation budget. steps are counted in lval_eval and lval_eval_ref,
+ * the clock is read every BUDGET_CLOCK_EVERY steps. once a budget is
+ * exceeded every further step fails with the same error, so evaluation
+ * unwinds through the normal error paths
  */
-lval* lval_eval_sexpr(lenv* e, lval* v) {
+#define BUDGET_CLOCK_EVERY 256
 
-    /* eval children */
-    for (int i=0; i<v->count; i++) {
-        v->cell[i] = lval_eval(e, v->cell[i]);
+static long budget_max_steps = 0;
+static long budget_timeout_ms = 0;
+
+static long budget_steps;
+static struct timespec budget_deadline;
+static int budget_tripped = LERR_OTHER;
+static volatile sig_atomic_t budget_active = 0;
+static volatile sig_atomic_t budget_cancelled = 0;
+
+void lbudget_set(long max_steps, long timeout_ms) {
+    budget_max_steps = max_steps;
+    budget_timeout_ms = timeout_ms;
+}
+
+void lbudget_start(void) {
+    budget_steps = 0;
+    budget_tripped = LERR_OTHER;
+    budget_cancelled = 0;
+    if (budget_timeout_ms) {
+        clock_gettime(CLOCK_MONOTONIC, &budget_deadline);
+        budget_deadline.tv_sec += budget_timeout_ms / 1000;
+        budget_deadline.tv_nsec += (budget_timeout_ms % 1000) * 1000000;
+        if (budget_deadline.tv_nsec >= 1000000000) {
+            budget_deadline.tv_sec++;
+            budget_deadline.tv_nsec -= 1000000000;
+        }
     }
+    budget_active = 1;
+}
 
-    /* check for errors */
-    for (int i=0; i < v->count; i++) {
-        if (v->cell[i]->type == LVAL_ERR) { return lval_take(v, i); }
+void lbudget_stop(void) {
+    budget_active = 0;
+}
+
+int lbudget_running(void) {
+    return budget_active;
+}
+
+/**
+ * safe to call from a signal handler
+ */
+void lbudget_cancel(void) {
+    budget_cancelled = 1;
+}
+
+int lbudget_exceeded(void) {
+    return budget_tripped != LERR_OTHER;
+}
+
+/**
+ * count one step. returns an error if the budget is used up. the memory
+ * quota applies even when no budget is running
+ */
+lval* lbudget_step(void) {
+    if (!budget_active) {
+        return lmem_exceeded() ? lval_err_code(LERR_NO_MEM) : NULL;
+    }
+    if (budget_tripped != LERR_OTHER) { return lval_err_code(budget_tripped); }
+
+    budget_steps++;
+    if (budget_cancelled) {
+        budget_tripped = LERR_CANCELLED;
+    } else if (lmem_exceeded()) {
+        budget_tripped = LERR_NO_MEM;
+    } else if (budget_max_steps && budget_steps > budget_max_steps) {
+        budget_tripped = LERR_STEPS;
+    } else if (budget_timeout_ms && budget_steps % BUDGET_CLOCK_EVERY == 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > budget_deadline.tv_sec ||
+                (now.tv_sec == budget_deadline.tv_sec &&
+                 now.tv_nsec >= budget_deadline.tv_nsec)) {
+            budget_tripped = LERR_TIMEOUT;
+        }
     }
+    return budget_tripped != LERR_OTHER ? lval_err_code(budget_tripped) : NULL;
+}
+
+/**
+ * apply s-expression whose children have been evaluated without error
+ */
+static lval* lval_eval_call(lenv* e, lval* v) {
 
     /* empty expr */
     if (v->count == 0) { return v; }
@@ -39,10 +121,26 @@ lval* lval_eval_sexpr(lenv* e, lval* v) {
     return result;
 }
 
+/**
+ * evaluate s-expression
+ */
+lval* lval_eval_sexpr(lenv* e, lval* v) {
+
+    /* eval children, stopping at the first error */
+    for (int i=0; i<v->count; i++) {
+        v->cell[i] = lval_eval(e, v->cell[i]);
+        if (v->cell[i]->type == LVAL_ERR) { return lval_take(v, i); }
+    }
+    return lval_eval_call(e, v);
+}
+
 /**
  * generic evaluation
  */
 lval* lval_eval(lenv* e, lval* v) {
+    lval* err = lbudget_step();
+    if (err) { lval_del(v); return err; }
+
     if (v->type == LVAL_SYM) {
         lval* x = lenv_get(e, v);
         lval_del(v);
@@ -53,76 +151,142 @@ lval* lval_eval(lenv* e, lval* v) {
 }
 
 /**
- * make function call
+ * evaluate the cells of v as an s-expression, leaving v untouched. only
+ * the atoms and q-expressions that end up as arguments are copied
+ */
+lval* lval_eval_body(lenv* e, lval* v) {
+    lval* x = lval_sexpr();
+    x->count = v->count;
+    x->cell = lalloc(sizeof(lval*) * x->count);
+    for (int i=0; i < v->count; i++) {
+        x->cell[i] = lval_eval_ref(e, v->cell[i]);
+        if (x->cell[i]->type == LVAL_ERR) {
+            /* cells after i were never filled in */
+            x->count = i+1;
+            return lval_take(x, i);
+        }
+    }
+    return lval_eval_call(e, x);
+}
+
+/**
+ * evaluation that does not consume v
+ */
+lval* lval_eval_ref(lenv* e, lval* v) {
+    lval* err = lbudget_step();
+    if (err) { return err; }
+
+    if (v->type == LVAL_SYM) { return lenv_get(e, v); }
+    if (v->type == LVAL_SEXPR) { return lval_eval_body(e, v); }
+    return lval_copy(v);
+}
+
+/**
+ * call lambda with exactly as many arguments as it has formals and nothing
+ * bound yet. arguments are moved straight into a scratch frame, under
+ * names borrowed from the formals, which f keeps alive for the call
+ */
+static lval* lval_call_fixed(lenv* e, lval* f, lval* a) {
+    if (f->body->numeric) {
+        lval* x = lval_call_numeric(e, f, a);
+        if (x) { return x; }
+    }
+
+    lenv* frame = lenv_push(e);
+    lval** syms = f->formals->cell;
+    lval** args = a->cell;
+
+    for (int i=0; i < a->count; i++) {
+        lenv_bind_borrowed(frame, syms[i]->sym, args[i]);
+    }
+    /* arguments now belong to the frame */
+    a->count = 0;
+    lval_del(a);
+
+    lval* x = lval_eval_body(frame, f->body);
+    lenv_pop(frame);
+    return x;
+}
+
+/**
+ * delete argument list whose first n cells have been moved elsewhere
+ */
+static void lval_del_rest(lval* a, int n) {
+    for (int i=n; i < a->count; i++) {
+        lval_del(a->cell[i]);
+    }
+    a->count = 0;
+    lval_del(a);
+}
+
+/**
+ * make function call. the formals and body of f are shared between
+ * copies and are never modified; bindings made by earlier partial
+ * applications live in f->env, one per formal consumed
  */
 lval* lval_call(lenv* e, lval* f, lval* a) {
     if (f->builtin) { return f->builtin(e, a); }
 
-    int given = a->count;
+    if (!f->variadic && f->env->count == 0 && a->count == f->arity) {
+        return lval_call_fixed(e, f, a);
+    }
+
+    lval** syms = f->formals->cell;
     int total = f->formals->count;
+    int given = a->count;
+
+    /* next formal to bind */
+    int i = f->env->count;
+    int done = 0;
 
-    while (a->count) {
+    int j = 0;
+    for (; j < a->count; j++) {
 
         /* no more arguments to bind */
-        if (f->formals->count == 0) {
-            lval_del(a);
+        if (i == total) {
+            lval_del_rest(a, j);
             return lval_err(
                 "function passed too many arguments. expected %i, got %i",
                 total, given);
         }
-        /* get next formal symbol */
-        lval* sym = lval_pop(f->formals, 0);
 
-        if (strcmp(sym->sym, "&") == 0) {
+        if (f->variadic && i == f->arity) {
             /* & must be followed by more symbols */
-            if (f->formals->count != 1) {
-                lval_del(a);
-                return lval_err("function format invalid. \
-                        '&' must be followed by at least one symbol");
+            if (total - i != 2) {
+                lval_del_rest(a, j);
+                return lval_err_code(LERR_BAD_FORMALS);
             }
             /* next formal should be bound to remaining arguments */
-            lval* nsym = lval_pop(f->formals, 0);
-            lenv_put(f->env, nsym, builtin_list(e, a));
-            lval_del(sym); lval_del(nsym);
+            lval* rest = lval_qexpr();
+            for (; j < a->count; j++) {
+                lval_add(rest, a->cell[j]);
+            }
+            lenv_bind(f->env, syms[i+1]->sym, rest);
+            done = 1;
             break;
         }
 
-        /* get next argument from list */
-        lval* val = lval_pop(a, 0);
-        /* bind copy into function environment */
-        lenv_put(f->env, sym, val);
-        /* delete symbol and value */
-        lval_del(sym); lval_del(val);
-
+        /* bind argument into function environment */
+        lenv_bind(f->env, syms[i]->sym, a->cell[j]);
+        i++;
     }
 
-    lval_del(a);
+    lval_del_rest(a, j);
 
     /* if '&' remains to bind to empty list */
-    if (f->formals->count > 0 &&
-            strcmp(f->formals->cell[0]->sym, "&") == 0) {
+    if (!done && f->variadic && i == f->arity) {
 
-        if (f->formals->count != 2) {
-            return lval_err("function format invalid.\
-                    '&' most be followed by at least one symbol");
+        if (total - i != 2) {
+            return lval_err_code(LERR_BAD_FORMALS);
         }
-
-        /* pop and delete '&' */
-        lval_del(lval_pop(f->formals, 0));
-        /* pop next symbol and create empty list */
-        lval* sym = lval_pop(f->formals, 0);
-        lval* val = lval_qexpr();
-        /* bind to environment and delete */
-        lenv_put(f->env, sym, val);
-        lval_del(sym); lval_del(val);
+        lenv_bind(f->env, syms[i+1]->sym, lval_qexpr());
+        done = 1;
     }
 
     /* all formals have been bound */
-    if (f->formals->count == 0) {
-
+    if (done || i == total) {
         f->env->par = e;
-        return builtin_eval(f->env,
-                lval_add(lval_sexpr(), lval_copy(f->body)));
+        return lval_eval_body(f->env, f->body);
     } else {
         return lval_copy(f);
     }
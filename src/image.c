@@ -0,0 +1,276 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "builtin.h"
+#include "infer.h"
+#include "image.h"
+
+/**
+ * heap images
+ *
+ * the global environment is written out binding by binding. values are a
+ * type byte followed by their contents; strings are a 32 bit length and
+ * the bytes. builtins are stored by name and looked up again on load,
+ * lambdas by their formals, body and any partial bindings. everything is
+ * in host byte order; the header records enough to refuse an image from a
+ * different kind of machine.
+ */
+
+#define IMAGE_MAGIC   "LSPI"
+#define IMAGE_VERSION 1
+
+static void put_u8(FILE* f, uint8_t x) { fwrite(&x, 1, 1, f); }
+static void put_u32(FILE* f, uint32_t x) { fwrite(&x, sizeof(x), 1, f); }
+static void put_long(FILE* f, long x) { fwrite(&x, sizeof(x), 1, f); }
+
+static void put_str(FILE* f, char* s) {
+    uint32_t n = strlen(s);
+    put_u32(f, n);
+    fwrite(s, 1, n, f);
+}
+
+static void put_val(FILE* f, lval* v) {
+    put_u8(f, v->type);
+    switch (v->type) {
+        case LVAL_NUM: put_long(f, v->num); break;
+        case LVAL_ERR: put_str(f, v->err); break;
+        case LVAL_SYM: put_str(f, v->sym); break;
+        case LVAL_STR: put_str(f, v->str); break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            put_u32(f, v->count);
+            for (int i=0; i < v->count; i++) { put_val(f, v->cell[i]); }
+            break;
+        case LVAL_FUN:
+            put_u8(f, v->builtin != NULL);
+            if (v->builtin) {
+                put_str(f, builtin_name(v->builtin));
+                break;
+            }
+            put_val(f, v->formals);
+            put_val(f, v->body);
+            put_u32(f, v->env->count);
+            for (int i=0; i < v->env->count; i++) {
+                put_str(f, v->env->syms[i]);
+                put_val(f, v->env->vals[i]);
+            }
+            break;
+    }
+}
+
+lval* image_dump(lenv* e, char* filename) {
+    while (e->par) { e = e->par; }
+
+    FILE* f = fopen(filename, "wb");
+    if (!f) { return lval_err("could not open %s for writing", filename); }
+
+    fwrite(IMAGE_MAGIC, 1, 4, f);
+    put_u32(f, IMAGE_VERSION);
+    put_u32(f, sizeof(long));
+    put_u32(f, e->count);
+    for (int i=0; i < e->count; i++) {
+        put_str(f, e->syms[i]);
+        put_val(f, e->vals[i]);
+    }
+
+    int failed = ferror(f);
+    fclose(f);
+    return failed
+        ? lval_err("could not write image %s", filename)
+        : lval_sexpr();
+}
+
+/**
+ * reading. pos only ever moves forward and every read is checked against
+ * end, so a truncated or corrupt image fails cleanly
+ */
+typedef struct {
+    unsigned char* pos;
+    unsigned char* end;
+    char* err;
+    char* buf;
+    uint32_t cap;
+} reader;
+
+static int get(reader* r, void* out, size_t n) {
+    if (r->err || (size_t)(r->end - r->pos) < n) {
+        if (!r->err) { r->err = "image truncated"; }
+        return 0;
+    }
+    memcpy(out, r->pos, n);
+    r->pos += n;
+    return 1;
+}
+
+/**
+ * formals as builtin_lambda accepts them: distinct symbols
+ */
+static int formals_ok(lval* formals) {
+    if (formals->type != LVAL_QEXPR) { return 0; }
+    for (int i=0; i < formals->count; i++) {
+        if (formals->cell[i]->type != LVAL_SYM) { return 0; }
+        for (int j=0; j < i; j++) {
+            if (strcmp(formals->cell[i]->sym, formals->cell[j]->sym) == 0) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static uint32_t get_u32(reader* r) {
+    uint32_t x = 0;
+    get(r, &x, sizeof(x));
+    return x;
+}
+
+/**
+ * string from the image, in a scratch buffer valid until the next call
+ */
+static char* get_str(reader* r) {
+    uint32_t n = get_u32(r);
+    if (r->err) { return NULL; }
+    if ((size_t)(r->end - r->pos) < n) {
+        r->err = "image truncated";
+        return NULL;
+    }
+    if (n + 1 > r->cap) {
+        r->cap = n + 1;
+        r->buf = realloc(r->buf, r->cap);
+    }
+    get(r, r->buf, n);
+    r->buf[n] = '\0';
+    return r->buf;
+}
+
+static lval* get_val(reader* r) {
+    uint8_t type = 0;
+    if (!get(r, &type, 1)) { return NULL; }
+
+    char* s;
+    switch (type) {
+        case LVAL_NUM: {
+            long x = 0;
+            return get(r, &x, sizeof(x)) ? lval_num(x) : NULL;
+        }
+        case LVAL_ERR:
+            return (s = get_str(r)) ? lval_err("%s", s) : NULL;
+        case LVAL_SYM:
+            return (s = get_str(r)) ? lval_sym(s) : NULL;
+        case LVAL_STR:
+            return (s = get_str(r)) ? lval_str(s) : NULL;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR: {
+            uint32_t n = get_u32(r);
+            lval* v = type == LVAL_SEXPR ? lval_sexpr() : lval_qexpr();
+            for (uint32_t i=0; i < n; i++) {
+                lval* x = get_val(r);
+                if (!x) { lval_del(v); return NULL; }
+                lval_add(v, x);
+            }
+            return v;
+        }
+        case LVAL_FUN: {
+            uint8_t builtin = 0;
+            if (!get(r, &builtin, 1)) { return NULL; }
+            if (builtin) {
+                if (!(s = get_str(r))) { return NULL; }
+                lbuiltin func = builtin_find(s);
+                if (!func) { r->err = "image refers to unknown builtin"; return NULL; }
+                return lval_fun(func);
+            }
+
+            lval* formals = get_val(r);
+            lval* body = formals ? get_val(r) : NULL;
+            if (!body) {
+                if (formals) { lval_del(formals); }
+                return NULL;
+            }
+            if (!formals_ok(formals) || body->type != LVAL_QEXPR) {
+                lval_del(formals); lval_del(body);
+                r->err = "image has malformed function";
+                return NULL;
+            }
+            lval* f = lval_lambda(formals, body);
+            f->body->numeric = lval_infer_numeric(f);
+
+            /* partial application only ever binds formals before & */
+            uint32_t n = get_u32(r);
+            if (!r->err && n > (uint32_t)f->arity) {
+                lval_del(f);
+                r->err = "image has malformed function";
+                return NULL;
+            }
+            for (uint32_t i=0; i < n; i++) {
+                lval* k = (s = get_str(r)) ? lval_sym(s) : NULL;
+                lval* x = k ? get_val(r) : NULL;
+                if (!x) {
+                    if (k) { lval_del(k); }
+                    lval_del(f);
+                    return NULL;
+                }
+                lenv_bind(f->env, k->sym, x);
+                lval_del(k);
+            }
+            return f;
+        }
+    }
+    r->err = "image has unknown value type";
+    return NULL;
+}
+
+/**
+ * bind everything in the image into e
+ */
+lval* image_load(lenv* e, char* filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) { return lval_err("could not open image %s", filename); }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return lval_err("could not open image %s", filename);
+    }
+    size_t size = st.st_size;
+
+    void* data = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0) : NULL;
+    close(fd);
+    if (size && data == MAP_FAILED) {
+        return lval_err("could not map image %s", filename);
+    }
+
+    reader r = { data, (unsigned char*)data + size, NULL, NULL, 0 };
+
+    char magic[4] = {0};
+    get(&r, magic, 4);
+    uint32_t version = get_u32(&r);
+    uint32_t long_size = get_u32(&r);
+    if (!r.err && (memcmp(magic, IMAGE_MAGIC, 4) != 0 ||
+                version != IMAGE_VERSION || long_size != sizeof(long))) {
+        r.err = "not an image for this version of lispy";
+    }
+
+    uint32_t n = get_u32(&r);
+    for (uint32_t i=0; i < n && !r.err; i++) {
+        char* s = get_str(&r);
+        lval* k = s ? lval_sym(s) : NULL;
+        lval* v = k ? get_val(&r) : NULL;
+        if (v) { lenv_put(e, k, v); lval_del(v); }
+        if (k) { lval_del(k); }
+    }
+
+    free(r.buf);
+    if (size) { munmap(data, size); }
+    return r.err
+        ? lval_err("could not load image %s: %s", filename, r.err)
+        : lval_sexpr();
+}
@@ -0,0 +1,246 @@
+#include <string.h>
+
+#include "types.h"
+#include "eval.h"
+#include "infer.h"
+#include "builtin.h"
+
+int infer_enabled = 1;
+
+/**
+ * numeric lambdas
+ *
+ * a lambda is numeric when, assuming all of its formals are numbers, every
+ * expression in its body provably is a number too. that holds for number
+ * literals, formals, arithmetic and comparison on numeric expressions, if
+ * with a numeric condition and numeric branches, and calls to other
+ * functions with numeric arguments. if is recognised by its shape rather
+ * than its name, since any symbol may turn out to be bound to it.
+ *
+ * operators are only symbols at this point; with dynamic scope they can
+ * only be resolved at call time. when a numeric lambda is called with
+ * numbers only, its body is run on raw longs and each operator is looked
+ * up as it is reached. if one turns out to be something we cannot run
+ * unboxed, the whole call is abandoned and redone the normal way. the
+ * unboxed subset has no side effects, so that is always safe. the flag
+ * lives on the body, which all copies of a lambda share, so once one
+ * call gives up the others do not try again.
+ */
+
+static int is_formal(lval* formals, char* sym) {
+    for (int i=0; i < formals->count; i++) {
+        if (strcmp(formals->cell[i]->sym, sym) == 0) { return 1; }
+    }
+    return 0;
+}
+
+static int infer_expr(lval* formals, lval* x);
+
+/**
+ * a condition and two q-expression branches, as builtin_if takes
+ */
+static int is_if_shaped(lval* x) {
+    return x->count == 4 &&
+        x->cell[2]->type == LVAL_QEXPR && x->cell[3]->type == LVAL_QEXPR;
+}
+
+/**
+ * cells of an s-expression, or of a q-expression about to be evaluated
+ */
+static int infer_call(lval* formals, lval* x) {
+    if (x->count == 0) { return 0; }
+    if (x->count == 1) { return infer_expr(formals, x->cell[0]); }
+
+    lval* op = x->cell[0];
+    if (op->type != LVAL_SYM || is_formal(formals, op->sym)) { return 0; }
+
+    /* the operator is only known at call time, so anything shaped like an
+     * if is taken as one; num_call checks that it really is */
+    if (is_if_shaped(x)) {
+        for (int i=2; i < 4; i++) {
+            if (!infer_call(formals, x->cell[i])) { return 0; }
+        }
+        return infer_expr(formals, x->cell[1]);
+    }
+
+    for (int i=1; i < x->count; i++) {
+        if (!infer_expr(formals, x->cell[i])) { return 0; }
+    }
+    return 1;
+}
+
+static int infer_expr(lval* formals, lval* x) {
+    switch (x->type) {
+        case LVAL_NUM: return 1;
+        case LVAL_SYM: return is_formal(formals, x->sym);
+        case LVAL_SEXPR: return infer_call(formals, x);
+        default: return 0;
+    }
+}
+
+int lval_infer_numeric(lval* f) {
+    if (!infer_enabled || f->builtin || f->variadic) { return 0; }
+    return infer_call(f->formals, f->body);
+}
+
+/**
+ * unboxed evaluation
+ */
+
+enum { NUM_OK, NUM_BAIL, NUM_ERR };
+
+typedef struct numframe {
+    lval* formals;
+    long* args;
+    struct numframe* par;
+} numframe;
+
+static int num_eval(lenv* e, numframe* fr, lval* x, long* out, lval** err);
+
+static int num_arg(numframe* fr, char* sym, long* out) {
+    for (int i=0; i < fr->formals->count; i++) {
+        if (strcmp(fr->formals->cell[i]->sym, sym) == 0) {
+            *out = fr->args[i];
+            return NUM_OK;
+        }
+    }
+    return NUM_BAIL;
+}
+
+/**
+ * resolve operator the way lenv_get would see it. formals of the unboxed
+ * frames we are inside would shadow it, and those are never functions
+ */
+static lval* num_resolve(lenv* e, numframe* fr, char* sym) {
+    for (; fr; fr = fr->par) {
+        if (is_formal(fr->formals, sym)) { return NULL; }
+    }
+    lval* f = lenv_lookup(e, sym);
+    return (f && f->type == LVAL_FUN) ? f : NULL;
+}
+
+static int num_op(lbuiltin op, long* xs, int n, long* out, lval** err) {
+    long x = xs[0];
+    if (op == builtin_sub && n == 1) { x = -x; }
+    for (int i=1; i < n; i++) {
+        if (op == builtin_add) { x += xs[i]; }
+        if (op == builtin_sub) { x -= xs[i]; }
+        if (op == builtin_mul) { x *= xs[i]; }
+        if (op == builtin_div) {
+            if (xs[i] == 0) {
+                *err = lval_err_code(LERR_DIV_ZERO);
+                return NUM_ERR;
+            }
+            x /= xs[i];
+        }
+    }
+    *out = x;
+    return NUM_OK;
+}
+
+static int num_cmp(lbuiltin op, long x, long y, long* out) {
+    if (op == builtin_gt) { *out = x > y; }
+    if (op == builtin_lt) { *out = x < y; }
+    if (op == builtin_ge) { *out = x >= y; }
+    if (op == builtin_le) { *out = x <= y; }
+    if (op == builtin_eq) { *out = x == y; }
+    if (op == builtin_ne) { *out = x != y; }
+    return NUM_OK;
+}
+
+static int num_call(lenv* e, numframe* fr, lval* x, long* out, lval** err) {
+    if (x->count == 1) { return num_eval(e, fr, x->cell[0], out, err); }
+
+    lval* f = num_resolve(e, fr, x->cell[0]->sym);
+    if (!f) { return NUM_BAIL; }
+
+    int r;
+    if (f->builtin == builtin_if) {
+        if (!is_if_shaped(x)) { return NUM_BAIL; }
+        long c;
+        if ((r = num_eval(e, fr, x->cell[1], &c, err)) != NUM_OK) { return r; }
+        return num_call(e, fr, x->cell[c ? 2 : 3], out, err);
+    }
+
+    int n = x->count - 1;
+    if (n > INFER_MAX_ARGS) { return NUM_BAIL; }
+
+    lbuiltin op = f->builtin;
+    int arith = op == builtin_add || op == builtin_sub ||
+        op == builtin_mul || op == builtin_div;
+    int cmp = op == builtin_gt || op == builtin_lt || op == builtin_ge ||
+        op == builtin_le || op == builtin_eq || op == builtin_ne;
+
+    if (op && !arith && !cmp) { return NUM_BAIL; }
+    if (cmp && n != 2) { return NUM_BAIL; }
+    if (!op && (!f->body->numeric || f->arity != n || f->env->count != 0)) {
+        return NUM_BAIL;
+    }
+
+    long xs[INFER_MAX_ARGS];
+    for (int i=0; i < n; i++) {
+        if ((r = num_eval(e, fr, x->cell[i+1], &xs[i], err)) != NUM_OK) {
+            return r;
+        }
+    }
+
+    if (arith) { return num_op(op, xs, n, out, err); }
+    if (cmp) { return num_cmp(op, xs[0], xs[1], out); }
+
+    /* another numeric lambda; stays unboxed */
+    numframe callee = { f->formals, xs, fr };
+    r = num_call(e, &callee, f->body, out, err);
+    if (r == NUM_BAIL) {
+        /* the body is shared by every copy of f; none of them tries again */
+        f->body->numeric = 0;
+    }
+    return r;
+}
+
+static int num_eval(lenv* e, numframe* fr, lval* x, long* out, lval** err) {
+    lval* stop = lbudget_step();
+    if (stop) { *err = stop; return NUM_ERR; }
+
+    switch (x->type) {
+        case LVAL_NUM: *out = x->num; return NUM_OK;
+        case LVAL_SYM: return num_arg(fr, x->sym, out);
+        case LVAL_SEXPR: return num_call(e, fr, x, out, err);
+        default: return NUM_BAIL;
+    }
+}
+
+lval* lval_call_numeric(lenv* e, lval* f, lval* a) {
+    if (a->count > INFER_MAX_ARGS) { return NULL; }
+
+    long xs[INFER_MAX_ARGS];
+    for (int i=0; i < a->count; i++) {
+        if (a->cell[i]->type != LVAL_NUM) { return NULL; }
+        xs[i] = a->cell[i]->num;
+    }
+
+    /* code written for it by --emit-c, which gives up the same way */
+    if (f->body->native) {
+        lval* x = f->body->native(e, xs);
+        if (x) {
+            lval_del(a);
+            return x;
+        }
+    }
+
+    numframe fr = { f->formals, xs, NULL };
+    long out;
+    lval* err = NULL;
+    switch (num_call(e, &fr, f->body, &out, &err)) {
+        case NUM_OK:
+            lval_del(a);
+            return lval_num(out);
+        case NUM_ERR:
+            lval_del(a);
+            return err;
+        default:
+            /* f is the caller's copy, but the body is shared with the
+             * bound value, so later calls go the normal way at once */
+            f->body->numeric = 0;
+            return NULL;
+    }
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "types.h"
+#include "eval.h"
+#include "parser.h"
+#include "lazy.h"
+
+/**
+ * lazy loading
+ *
+ * instead of evaluating a library up front, its text is scanned once for
+ * top-level forms. (def {...} ...) and (fun {...} ...) forms are indexed
+ * by the names they define and left alone; anything else is evaluated
+ * straight away, in order. when a lookup misses in the global environment
+ * the form defining that name is parsed and evaluated, once.
+ */
+
+typedef struct {
+    char* name;
+    int form;
+} lazy_name;
+
+typedef struct {
+    char* text;
+    int len;
+    int loaded;
+} lazy_form;
+
+static char* lazy_buf = NULL;
+
+static lazy_name* names = NULL;
+static int names_count = 0;
+
+static lazy_form* forms = NULL;
+static int forms_count = 0;
+
+static int is_symbol_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9') || strchr("_+-*/\\=<>!&", c);
+}
+
+static char* skip_space(char* s, char* end) {
+    while (s < end) {
+        if (*s == ';') {
+            while (s < end && *s != '\n') { s++; }
+        } else if (*s == ' ' || *s == '\t' || *s == '\r' || *s == '\n') {
+            s++;
+        } else {
+            break;
+        }
+    }
+    return s;
+}
+
+/**
+ * end of the form starting at s, or NULL if it never closes
+ */
+static char* skip_form(char* s, char* end) {
+    int depth = 0;
+    while (s < end) {
+        char c = *s++;
+        if (c == ';') {
+            while (s < end && *s != '\n') { s++; }
+        } else if (c == '"') {
+            while (s < end && *s != '"') {
+                if (*s == '\\') { s++; }
+                s++;
+            }
+            s++;
+        } else if (c == '(' || c == '{') {
+            depth++;
+        } else if (c == ')' || c == '}') {
+            if (--depth == 0) { return s; }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * length of the symbol at s
+ */
+static int symbol_len(char* s, char* end) {
+    int n = 0;
+    while (s + n < end && is_symbol_char(s[n])) { n++; }
+    return n;
+}
+
+static void add_name(char* s, int n, int form) {
+    names = realloc(names, sizeof(lazy_name) * (names_count+1));
+    names[names_count].name = malloc(n+1);
+    memcpy(names[names_count].name, s, n);
+    names[names_count].name[n] = '\0';
+    names[names_count].form = form;
+    names_count++;
+}
+
+/**
+ * index the names a definition form defines. returns 0 if it is not one
+ */
+static int index_form(char* s, char* end, int form) {
+    s = skip_space(s+1, end);
+    int n = symbol_len(s, end);
+    int is_fun = n == 3 && strncmp(s, "fun", 3) == 0;
+    int is_def = n == 3 && strncmp(s, "def", 3) == 0;
+    if (!is_fun && !is_def) { return 0; }
+
+    s = skip_space(s+n, end);
+    if (*s != '{') { return 0; }
+    s = skip_space(s+1, end);
+
+    int found = 0;
+    while ((n = symbol_len(s, end)) > 0) {
+        add_name(s, n, form);
+        found = 1;
+        /* fun only defines the first symbol */
+        if (is_fun) { break; }
+        s = skip_space(s+n, end);
+    }
+    return found;
+}
+
+static void eval_text(lenv* e, char* text, int len) {
+    char* src = malloc(len+1);
+    memcpy(src, text, len);
+    src[len] = '\0';
+
+    lval* x = parse(src);
+    free(src);
+    if (!x) { return; }
+
+    while (x->count) {
+        lval* r = lval_eval(e, lval_pop(x, 0));
+        if (r->type == LVAL_ERR) { lval_println(r); }
+        lval_del(r);
+    }
+    lval_del(x);
+}
+
+/**
+ * called by lenv_get when sym is not bound anywhere
+ */
+static int lazy_miss(lenv* e, char* sym) {
+    for (int i=0; i < names_count; i++) {
+        if (strcmp(names[i].name, sym) != 0) { continue; }
+
+        lazy_form* f = &forms[names[i].form];
+        if (f->loaded) { return 0; }
+        f->loaded = 1;
+        eval_text(e, f->text, f->len);
+        return 1;
+    }
+    return 0;
+}
+
+lval* lazy_load(lenv* e, char* filename) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) { return lval_err("could not load library %s", filename); }
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    lazy_buf = malloc(size+1);
+    size = fread(lazy_buf, 1, size, f);
+    lazy_buf[size] = '\0';
+    fclose(f);
+
+    while (e->par) { e = e->par; }
+    lenv_on_miss = lazy_miss;
+
+    char* end = lazy_buf + size;
+    char* s = skip_space(lazy_buf, end);
+    while (s < end) {
+        char* next;
+        if (*s == '(') {
+            next = skip_form(s, end);
+            if (!next) { return lval_err("unterminated form in %s", filename); }
+
+            forms = realloc(forms, sizeof(lazy_form) * (forms_count+1));
+            forms[forms_count].text = s;
+            forms[forms_count].len = next - s;
+            forms[forms_count].loaded = 0;
+
+            if (!index_form(s, end, forms_count)) {
+                forms[forms_count].loaded = 1;
+                eval_text(e, s, next - s);
+            }
+            forms_count++;
+        } else if (*s == '"') {
+            /* stray string; evaluating it would do nothing */
+            next = s+1;
+            while (next < end && *next != '"') {
+                if (*next == '\\') { next++; }
+                next++;
+            }
+            next++;
+        } else {
+            /* stray atom, likewise */
+            int n = symbol_len(s, end);
+            next = s + (n ? n : 1);
+        }
+        s = skip_space(next, end);
+    }
+    return lval_sexpr();
+}
+
+void lazy_free(void) {
+    for (int i=0; i < names_count; i++) { free(names[i].name); }
+    free(names);
+    free(forms);
+    free(lazy_buf);
+    names = NULL; forms = NULL; lazy_buf = NULL;
+    names_count = forms_count = 0;
+    lenv_on_miss = NULL;
+}
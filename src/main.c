@@ -1,25 +1,137 @@
+#include <signal.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "parser.h"
 #include "types.h"
 #include "eval.h"
 #include "builtin.h"
 #include "prompt.h"
+#include "infer.h"
+#include "compile.h"
+#include "shake.h"
+#include "lazy.h"
+#include "image.h"
+
+/**
+ * ctrl+c cancels the running evaluation, or exits when there is none
+ */
+static void on_sigint(int sig) {
+    if (lbudget_running()) {
+        lbudget_cancel();
+    } else {
+        signal(sig, SIG_DFL);
+        raise(sig);
+    }
+}
 
 int main(int argc, char** argv) {
 
-    init_parser();
+    /* pick out options, leaving file names in argv */
+    long max_steps = 0;
+    long timeout_ms = 0;
+    char* emit_c = NULL;
+    char* bundle = NULL;
+    char* prelude = "prelude.lsp";
+    char* image = NULL;
+    char* dump_image = NULL;
+    int lazy = 0;
+    int n = 1;
+    for (int i=1; i<argc; i++) {
+        if (strcmp(argv[i], "--max-steps") == 0 && i+1 < argc) {
+            max_steps = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--timeout") == 0 && i+1 < argc) {
+            timeout_ms = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mem-quota") == 0 && i+1 < argc) {
+            lmem_set_quota(strtoul(argv[++i], NULL, 10));
+        } else if (strcmp(argv[i], "--no-infer") == 0) {
+            infer_enabled = 0;
+        } else if (strcmp(argv[i], "--emit-c") == 0 && i+1 < argc) {
+            emit_c = argv[++i];
+        } else if (strcmp(argv[i], "--bundle") == 0 && i+1 < argc) {
+            bundle = argv[++i];
+        } else if (strcmp(argv[i], "--no-prelude") == 0) {
+            prelude = NULL;
+        } else if (strcmp(argv[i], "--lazy") == 0) {
+            lazy = 1;
+        } else if (strcmp(argv[i], "--reader") == 0 && i+1 < argc) {
+            i++;
+            if (strcmp(argv[i], "native") == 0) {
+                parser_reader = READER_NATIVE;
+            } else if (strcmp(argv[i], "mpc") == 0) {
+                parser_reader = READER_MPC;
+            } else if (strcmp(argv[i], "fold") == 0) {
+                parser_reader = READER_FOLD;
+            } else {
+                fprintf(stderr, "unknown reader %s\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--memo") == 0 && i+1 < argc) {
+            parser_memo = strtol(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--image") == 0 && i+1 < argc) {
+            image = argv[++i];
+        } else if (strcmp(argv[i], "--dump-image") == 0 && i+1 < argc) {
+            dump_image = argv[++i];
+        } else {
+            argv[n++] = argv[i];
+        }
+    }
+    argc = n;
+
+    lbudget_set(max_steps, timeout_ms);
+    signal(SIGINT, on_sigint);
 
     /* initialize environment */
     lenv* e = lenv_new();
     lenv_add_builtins(e);
 
-    /* load standard library functions */
-    lval* x = builtin_load(e, lval_add(lval_sexpr(), lval_str("prelude.lsp")));
-    if (x->type == LVAL_ERR) { lval_println(x); }
-    lval_del(x);
+    if (bundle) {
+
+        /* write prelude and files with unused definitions left out */
+        argv[0] = prelude;
+        lval* x = prelude
+            ? shake_bundle(bundle, argc, argv)
+            : shake_bundle(bundle, argc-1, argv+1);
+        if (x->type == LVAL_ERR) { lval_println(x); }
+        lval_del(x);
+
+        lenv_del(e);
+        free_parser();
+        return 0;
+    }
+
+    /* load standard library functions, or just index them when lazy.
+     * everything needs to be there to write c. an image already holds
+     * whatever was loaded when it was dumped */
+    if (image) {
+        lval* x = image_load(e, image);
+        if (x->type == LVAL_ERR) { lval_println(x); }
+        lval_del(x);
+    } else if (prelude) {
+        lval* x = lazy && !emit_c && !dump_image
+            ? lazy_load(e, prelude)
+            : builtin_load(e, lval_add(lval_sexpr(), lval_str(prelude)));
+        if (x->type == LVAL_ERR) { lval_println(x); }
+        lval_del(x);
+    }
+
+    if (dump_image) {
+
+        /* run files, then save the global environment they leave behind */
+        if (argc >= 2) { parse_args(e, argc, argv); }
+        lval* x = image_dump(e, dump_image);
+        if (x->type == LVAL_ERR) { lval_println(x); }
+        lval_del(x);
+
+    } else if (emit_c) {
+
+        /* translate files to c instead of running them */
+        lval* x = compile_c(e, emit_c, argc-1, argv+1);
+        if (x->type == LVAL_ERR) { lval_println(x); }
+        lval_del(x);
 
-    if (argc >= 2) {
+    } else if (argc >= 2) {
 
         /* read from command line */
         parse_args(e, argc, argv);
@@ -32,7 +144,9 @@ int main(int argc, char** argv) {
             char* input = prompt();
             lval* x = parse(input);
             if (x != NULL) {
+                lbudget_start();
                 x = lval_eval(e, x);
+                lbudget_stop();
                 lval_println(x);
                 lval_del(x);
             }
@@ -42,6 +156,7 @@ int main(int argc, char** argv) {
     }
 
     /* cleanup */
+    lazy_free();
     lenv_del(e);
     free_parser();
 
@@ -1,5 +1,19 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "mpc.h"
 
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
 ** State Type
 */
@@ -31,7 +45,10 @@ static mpc_state_t mpc_state_new(void) {
 ** String is easy. The whole contents are 
 ** loaded into a buffer and scanned through.
 ** The cursor can jump around at will making 
-** backtracking easy.
+** backtracking easy. The length is taken once
+** up front, and a caller that knows it can
+** lend its own buffer instead of having it
+** copied.
 **
 ** The second is a File which is also somewhat
 ** easy. The contents are never loaded into 
@@ -49,22 +66,39 @@ static mpc_state_t mpc_state_new(void) {
 ** back we can simply start reading from the
 ** buffer instead of the input.
 **
+** The buffer is a ring that grows as needed.
+** Everything read goes through it, and bytes
+** are released again once the cursor has
+** passed them and no mark still refers to them.
+**
 ** Of course using `mpc_predictive` will disable
 ** backtracking and make LL(1) grammars easy
 ** to parse for all input methods.
 **
+** Finally files opened by name are Mapped. The
+** whole file is mapped into memory read only
+** and scanned through like a String, but with
+** its length stored rather than terminated. If
+** a file cannot be mapped it is read into a
+** buffer instead, and used the same way.
+**
 */
 
 enum {
   MPC_INPUT_STRING = 0,
   MPC_INPUT_FILE   = 1,
-  MPC_INPUT_PIPE   = 2
+  MPC_INPUT_PIPE   = 2,
+  MPC_INPUT_MAPPED = 3
 };
 
 enum {
   MPC_INPUT_MARKS_MIN = 32
 };
 
+enum {
+  MPC_INPUT_BUFFER_MIN = 4096
+};
+
 enum {
   MPC_INPUT_MEM_NUM = 512
 };
@@ -82,6 +116,16 @@ typedef struct {
   char *string;
   char *buffer;
   FILE *file;
+  long length;
+  int mapped;
+  int borrowed;
+  
+  long buffer_slots;
+  long buffer_start;
+  long buffer_head;
+  long buffer_len;
+  
+  struct mpc_memo_t *memo;
   
   int suppress;
   int backtrack;
@@ -98,7 +142,7 @@ typedef struct {
   
 } mpc_input_t;
 
-static mpc_input_t *mpc_input_new_string(const char *filename, const char *string) {
+static mpc_input_t *mpc_input_new_nstring(const char *filename, const char *string, long length, int borrowed) {
 
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
   
@@ -108,10 +152,24 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   
   i->state = mpc_state_new();
   
-  i->string = malloc(strlen(string) + 1);
-  strcpy(i->string, string);
+  if (borrowed) {
+    i->string = (char*)string;
+  } else {
+    i->string = malloc(length + 1);
+    memcpy(i->string, string, length);
+    i->string[length] = '\0';
+  }
   i->buffer = NULL;
   i->file = NULL;
+  i->length = length;
+  i->mapped = 0;
+  i->borrowed = borrowed;
+  i->buffer_slots = 0;
+  i->buffer_start = 0;
+  i->buffer_head = 0;
+  i->buffer_len = 0;
+  
+  i->memo = NULL;
   
   i->suppress = 0;
   i->backtrack = 1;
@@ -127,6 +185,10 @@ static mpc_input_t *mpc_input_new_string(const char *filename, const char *strin
   return i;
 }
 
+static mpc_input_t *mpc_input_new_string(const char *filename, const char *string) {
+  return mpc_input_new_nstring(filename, string, strlen(string), 0);
+}
+
 static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
 
   mpc_input_t *i = malloc(sizeof(mpc_input_t));
@@ -140,6 +202,16 @@ static mpc_input_t *mpc_input_new_pipe(const char *filename, FILE *pipe) {
   i->string = NULL;
   i->buffer = NULL;
   i->file = pipe;
+  i->length = 0;
+  i->mapped = 0;
+  i->borrowed = 0;
+  i->buffer = malloc(MPC_INPUT_BUFFER_MIN);
+  i->buffer_slots = MPC_INPUT_BUFFER_MIN;
+  i->buffer_start = 0;
+  i->buffer_head = 0;
+  i->buffer_len = 0;
+  
+  i->memo = NULL;
   
   i->suppress = 0;
   i->backtrack = 1;
@@ -168,6 +240,51 @@ static mpc_input_t *mpc_input_new_file(const char *filename, FILE *file) {
   i->string = NULL;
   i->buffer = NULL;
   i->file = file;
+  i->length = 0;
+  i->mapped = 0;
+  i->borrowed = 0;
+  i->buffer_slots = 0;
+  i->buffer_start = 0;
+  i->buffer_head = 0;
+  i->buffer_len = 0;
+  
+  i->memo = NULL;
+  
+  i->suppress = 0;
+  i->backtrack = 1;
+  i->marks_num = 0;
+  i->marks_slots = MPC_INPUT_MARKS_MIN;
+  i->marks = malloc(sizeof(mpc_state_t) * i->marks_slots);
+  i->lasts = malloc(sizeof(char) * i->marks_slots);
+  i->last = '\0';
+  
+  i->mem_index = 0;
+  memset(i->mem_full, 0, sizeof(char) * MPC_INPUT_MEM_NUM);
+  
+  return i;
+}
+
+static mpc_input_t *mpc_input_new_mapped(const char *filename, char *data, long length, int mapped) {
+  
+  mpc_input_t *i = malloc(sizeof(mpc_input_t));
+  
+  i->filename = malloc(strlen(filename) + 1);
+  strcpy(i->filename, filename);
+  i->type = MPC_INPUT_MAPPED;
+  i->state = mpc_state_new();
+  
+  i->string = data;
+  i->buffer = NULL;
+  i->file = NULL;
+  i->length = length;
+  i->mapped = mapped;
+  i->borrowed = 0;
+  i->buffer_slots = 0;
+  i->buffer_start = 0;
+  i->buffer_head = 0;
+  i->buffer_len = 0;
+  
+  i->memo = NULL;
   
   i->suppress = 0;
   i->backtrack = 1;
@@ -187,8 +304,10 @@ static void mpc_input_delete(mpc_input_t *i) {
   
   free(i->filename);
   
-  if (i->type == MPC_INPUT_STRING) { free(i->string); }
+  if (i->type == MPC_INPUT_STRING && !i->borrowed) { free(i->string); }
   if (i->type == MPC_INPUT_PIPE) { free(i->buffer); }
+  if (i->type == MPC_INPUT_MAPPED && i->mapped) { munmap(i->string, i->length); }
+  if (i->type == MPC_INPUT_MAPPED && !i->mapped) { free(i->string); }
   
   free(i->marks);
   free(i->lasts);
@@ -280,10 +399,6 @@ static void mpc_input_mark(mpc_input_t *i) {
   i->marks[i->marks_num-1] = i->state;
   i->lasts[i->marks_num-1] = i->last;
   
-  if (i->type == MPC_INPUT_PIPE && i->marks_num == 1) {
-    i->buffer = calloc(1, 1);
-  }
-  
 }
 
 static void mpc_input_unmark(mpc_input_t *i) {
@@ -301,11 +416,6 @@ static void mpc_input_unmark(mpc_input_t *i) {
     i->lasts = realloc(i->lasts, sizeof(char) * i->marks_slots);      
   }
   
-  if (i->type == MPC_INPUT_PIPE && i->marks_num == 0) {
-    free(i->buffer);
-    i->buffer = NULL;
-  }
-  
 }
 
 static void mpc_input_rewind(mpc_input_t *i) {
@@ -322,18 +432,65 @@ static void mpc_input_rewind(mpc_input_t *i) {
   mpc_input_unmark(i);
 }
 
-static int mpc_input_buffer_in_range(mpc_input_t *i) {
-  return i->state.pos < (long)(strlen(i->buffer) + i->marks[0].pos);
+/*
+** Append a byte to the ring, first dropping
+** whatever is before both the cursor and the
+** oldest mark.
+*/
+static void mpc_input_buffer_push(mpc_input_t *i, char c) {
+  
+  long keep = i->state.pos, j;
+  char *buffer;
+  
+  if (i->marks_num > 0 && i->marks[0].pos < keep) { keep = i->marks[0].pos; }
+  if (keep > i->buffer_start) {
+    i->buffer_head = (i->buffer_head + (keep - i->buffer_start)) & (i->buffer_slots - 1);
+    i->buffer_len -= keep - i->buffer_start;
+    i->buffer_start = keep;
+  }
+  
+  if (i->buffer_len == i->buffer_slots) {
+    buffer = malloc(i->buffer_slots * 2);
+    for (j = 0; j < i->buffer_len; j++) {
+      buffer[j] = i->buffer[(i->buffer_head + j) & (i->buffer_slots - 1)];
+    }
+    free(i->buffer);
+    i->buffer = buffer;
+    i->buffer_slots = i->buffer_slots * 2;
+    i->buffer_head = 0;
+  }
+  
+  i->buffer[(i->buffer_head + i->buffer_len) & (i->buffer_slots - 1)] = c;
+  i->buffer_len++;
+}
+
+/*
+** Make sure the byte at the cursor is in the
+** ring. Returns 0 at the end of the input.
+*/
+static int mpc_input_buffer_fill(mpc_input_t *i) {
+  
+  int c;
+  
+  while (i->state.pos >= i->buffer_start + i->buffer_len) {
+    if (feof(i->file)) { return 0; }
+    c = getc(i->file);
+    if (c == EOF) { return 0; }
+    mpc_input_buffer_push(i, c);
+  }
+  
+  return 1;
 }
 
 static char mpc_input_buffer_get(mpc_input_t *i) {
-  return i->buffer[i->state.pos - i->marks[0].pos];
+  return i->buffer[(i->buffer_head + (i->state.pos - i->buffer_start)) & (i->buffer_slots - 1)];
 }
 
 static int mpc_input_terminated(mpc_input_t *i) {
-  if (i->type == MPC_INPUT_STRING && i->state.pos == (long)strlen(i->string)) { return 1; }
+  if (i->type == MPC_INPUT_STRING && i->state.pos >= i->length) { return 1; }
   if (i->type == MPC_INPUT_FILE && feof(i->file)) { return 1; }
-  if (i->type == MPC_INPUT_PIPE && feof(i->file)) { return 1; }
+  if (i->type == MPC_INPUT_PIPE && !mpc_input_buffer_fill(i)) { return 1; }
+  if (i->type == MPC_INPUT_MAPPED && i->state.pos >= i->length) { return 1; }
   return 0;
 }
 
@@ -343,19 +500,12 @@ static char mpc_input_getc(mpc_input_t *i) {
   
   switch (i->type) {
     
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_STRING:
+    case MPC_INPUT_MAPPED:
+      return i->state.pos < i->length ? i->string[i->state.pos] : '\0';
     case MPC_INPUT_FILE: c = fgetc(i->file); return c;
     case MPC_INPUT_PIPE:
-    
-      if (!i->buffer) { c = getc(i->file); return c; }
-      
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        c = mpc_input_buffer_get(i);
-        return c;
-      } else {
-        c = getc(i->file);
-        return c;
-      }
+      return mpc_input_buffer_fill(i) ? mpc_input_buffer_get(i) : '\0';
     
     default: return c;
   }
@@ -366,7 +516,9 @@ static char mpc_input_peekc(mpc_input_t *i) {
   char c = '\0';
   
   switch (i->type) {
-    case MPC_INPUT_STRING: return i->string[i->state.pos];
+    case MPC_INPUT_STRING:
+    case MPC_INPUT_MAPPED:
+      return i->state.pos < i->length ? i->string[i->state.pos] : '\0';
     case MPC_INPUT_FILE: 
       
       c = fgetc(i->file);
@@ -376,22 +528,7 @@ static char mpc_input_peekc(mpc_input_t *i) {
       return c;
     
     case MPC_INPUT_PIPE:
-      
-      if (!i->buffer) {
-        c = getc(i->file);
-        if (feof(i->file)) { return '\0'; }
-        ungetc(c, i->file);
-        return c;
-      }
-      
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        return mpc_input_buffer_get(i);
-      } else {
-        c = getc(i->file);
-        if (feof(i->file)) { return '\0'; }
-        ungetc(c, i->file);
-        return c;
-      }
+      return mpc_input_buffer_fill(i) ? mpc_input_buffer_get(i) : '\0';
     
     default: return c;
   }
@@ -403,16 +540,6 @@ static int mpc_input_failure(mpc_input_t *i, char c) {
   switch (i->type) {
     case MPC_INPUT_STRING: { break; }
     case MPC_INPUT_FILE: fseek(i->file, -1, SEEK_CUR); { break; }
-    case MPC_INPUT_PIPE: {
-      
-      if (!i->buffer) { ungetc(c, i->file); break; }
-      
-      if (i->buffer && mpc_input_buffer_in_range(i)) {
-        break;
-      } else {
-        ungetc(c, i->file); 
-      }
-    }
     default: { break; }
   }
   return 0;
@@ -420,13 +547,6 @@ static int mpc_input_failure(mpc_input_t *i, char c) {
 
 static int mpc_input_success(mpc_input_t *i, char c, char **o) {
   
-  if (i->type == MPC_INPUT_PIPE
-  &&  i->buffer && !mpc_input_buffer_in_range(i)) {
-    i->buffer = realloc(i->buffer, strlen(i->buffer) + 2);
-    i->buffer[strlen(i->buffer) + 1] = '\0';
-    i->buffer[strlen(i->buffer) + 0] = c;
-  }
-  
   i->last = c;
   i->state.pos++;
   i->state.col++;
@@ -851,7 +971,11 @@ enum {
   MPC_TYPE_COUNT     = 22,
   
   MPC_TYPE_OR        = 23,
-  MPC_TYPE_AND       = 24
+  MPC_TYPE_AND       = 24,
+  
+  MPC_TYPE_DFA       = 25,
+  MPC_TYPE_SPAN      = 26,
+  MPC_TYPE_MEMO      = 27
 };
 
 typedef struct { char *m; } mpc_pdata_fail_t;
@@ -869,6 +993,9 @@ typedef struct { mpc_parser_t *x; mpc_dtor_t dx; mpc_ctor_t lf; } mpc_pdata_not_
 typedef struct { int n; mpc_fold_t f; mpc_parser_t *x; mpc_dtor_t dx; } mpc_pdata_repeat_t;
 typedef struct { int n; mpc_parser_t **xs; } mpc_pdata_or_t;
 typedef struct { int n; mpc_fold_t f; mpc_parser_t **xs; mpc_dtor_t *dxs;  } mpc_pdata_and_t;
+typedef struct { int n; short *next; char *accept; mpc_parser_t *x; char *m; } mpc_pdata_dfa_t;
+typedef struct { char *x; int comp; int min; unsigned char *set; int n; unsigned char *ranges; } mpc_pdata_span_t;
+typedef struct { mpc_parser_t *x; int slots; mpc_dup_t dup; mpc_dtor_t del; } mpc_pdata_memo_t;
 
 typedef union {
   mpc_pdata_fail_t fail;
@@ -886,6 +1013,9 @@ typedef union {
   mpc_pdata_repeat_t repeat;
   mpc_pdata_and_t and;
   mpc_pdata_or_t or;
+  mpc_pdata_dfa_t dfa;
+  mpc_pdata_span_t span;
+  mpc_pdata_memo_t memo;
 } mpc_pdata_t;
 
 struct mpc_parser_t {
@@ -895,6 +1025,187 @@ struct mpc_parser_t {
   mpc_pdata_t data;
 };
 
+/*
+** Move past n bytes of an in memory input at
+** once, as if each had been read on its own.
+*/
+static void mpc_input_advance(mpc_input_t *i, const char *s, long n) {
+  
+  const char *end = s + n, *line = s, *nl;
+  
+  if (n == 0) { return; }
+  
+  while ((nl = memchr(line, '\n', end - line)) != NULL) {
+    i->state.row++;
+    line = nl + 1;
+  }
+  
+  i->state.col = line == s ? i->state.col + n : end - line;
+  i->last = end[-1];
+  i->state.pos += n;
+}
+
+/*
+** Run a compiled regex over an in memory input,
+** taking the longest match. Only valid for
+** inputs with random access to their contents.
+*/
+static int mpc_input_dfa(mpc_input_t *i, mpc_pdata_dfa_t *d, char **o) {
+  
+  const unsigned char *s = (const unsigned char*)i->string + i->state.pos;
+  long n = i->length - i->state.pos;
+  long j, last = d->accept[0] ? 0 : -1;
+  int state = 0;
+  
+  for (j = 0; j < n; j++) {
+    state = d->next[state * 256 + s[j]];
+    if (state < 0) { break; }
+    if (d->accept[state]) { last = j + 1; }
+  }
+  
+  if (last < 0) { return 0; }
+  
+  *o = mpc_malloc(i, last + 1);
+  memcpy(*o, s, last);
+  (*o)[last] = '\0';
+  mpc_input_advance(i, (const char*)s, last);
+  
+  return 1;
+}
+
+/*
+** Spans
+**
+** A span consumes a whole run of characters from
+** a set in one step, rather than one character
+** per parser call as mpc_many of mpc_oneof does.
+**
+** Over in memory input the run is found sixteen
+** (SSE2) or thirty-two (AVX2) bytes at a time
+** when the set is made of a few byte ranges, and
+** by table lookup otherwise. The vector paths are
+** picked at compile time from the target flags.
+*/
+
+enum { MPC_SPAN_RANGES_MAX = 12 };
+
+static int mpc_span_has(const unsigned char *set, unsigned char c) {
+  return set[c / 8] & (1 << (c % 8));
+}
+
+static long mpc_span_scalar(const mpc_pdata_span_t *d, const unsigned char *s, long j, long n) {
+  while (j < n && mpc_span_has(d->set, s[j])) { j++; }
+  return j;
+}
+
+#if defined(__SSE2__)
+
+static int mpc_span_sse2(const mpc_pdata_span_t *d, const unsigned char *s) {
+  
+  __m128i x = _mm_loadu_si128((const __m128i*)s);
+  __m128i in = _mm_setzero_si128();
+  __m128i t;
+  int k;
+  
+  for (k = 0; k < d->n; k++) {
+    t = _mm_sub_epi8(x, _mm_set1_epi8((char)d->ranges[k*2+0]));
+    t = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8((char)(d->ranges[k*2+1] - d->ranges[k*2+0]))), t);
+    in = _mm_or_si128(in, t);
+  }
+  
+  return _mm_movemask_epi8(in);
+}
+
+#endif
+
+#if defined(__AVX2__)
+
+static unsigned int mpc_span_avx2(const mpc_pdata_span_t *d, const unsigned char *s) {
+  
+  __m256i x = _mm256_loadu_si256((const __m256i*)s);
+  __m256i in = _mm256_setzero_si256();
+  __m256i t;
+  int k;
+  
+  for (k = 0; k < d->n; k++) {
+    t = _mm256_sub_epi8(x, _mm256_set1_epi8((char)d->ranges[k*2+0]));
+    t = _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8((char)(d->ranges[k*2+1] - d->ranges[k*2+0]))), t);
+    in = _mm256_or_si256(in, t);
+  }
+  
+  return (unsigned int)_mm256_movemask_epi8(in);
+}
+
+#endif
+
+/* Length of the run of set characters at the start of s */
+static long mpc_span_run(const mpc_pdata_span_t *d, const unsigned char *s, long n) {
+  
+  long j = 0;
+  
+#if defined(__AVX2__)
+  unsigned int m32;
+#endif
+#if defined(__SSE2__)
+  int m16;
+#endif
+  
+  if (d->n > 0) {
+#if defined(__AVX2__)
+    for (; j + 32 <= n; j += 32) {
+      m32 = mpc_span_avx2(d, s + j);
+      if (m32 != 0xFFFFFFFFu) { return j + __builtin_ctz(~m32); }
+    }
+#endif
+#if defined(__SSE2__)
+    for (; j + 16 <= n; j += 16) {
+      m16 = mpc_span_sse2(d, s + j);
+      if (m16 != 0xFFFF) { return j + __builtin_ctz(~m16); }
+    }
+#endif
+  }
+  
+  return mpc_span_scalar(d, s, j, n);
+}
+
+static int mpc_input_span(mpc_input_t *i, mpc_pdata_span_t *d, char **o) {
+  
+  const unsigned char *s;
+  long n, slots;
+  char c;
+  
+  if (i->type == MPC_INPUT_STRING || i->type == MPC_INPUT_MAPPED) {
+    s = (const unsigned char*)i->string + i->state.pos;
+    n = mpc_span_run(d, s, i->length - i->state.pos);
+    if (n < d->min) { return 0; }
+    *o = mpc_malloc(i, n + 1);
+    memcpy(*o, s, n);
+    (*o)[n] = '\0';
+    mpc_input_advance(i, (const char*)s, n);
+    return 1;
+  }
+  
+  n = 0;
+  slots = 16;
+  *o = mpc_malloc(i, slots);
+  
+  while (1) {
+    c = mpc_input_getc(i);
+    if (mpc_input_terminated(i)) { break; }
+    if (!mpc_span_has(d->set, c)) { mpc_input_failure(i, c); break; }
+    mpc_input_success(i, c, NULL);
+    if (n + 1 == slots) {
+      slots *= 2;
+      *o = mpc_realloc(i, *o, slots);
+    }
+    (*o)[n++] = c;
+  }
+  
+  (*o)[n] = '\0';
+  if (n < d->min) { mpc_free(i, *o); return 0; }
+  return 1;
+}
+
 static mpc_val_t *mpcf_input_nth_free(mpc_input_t *i, int n, mpc_val_t **xs, int x) {
   int j;
   for (j = 0; j < n; j++) { if (j != x) { mpc_free(i, xs[j]); } }
@@ -975,8 +1286,163 @@ enum {
   if (x) { MPC_SUCCESS(r->output); } \
   else { MPC_FAILURE(NULL); }
 
+static mpc_parser_t *mpc_re_combinators(const char *re);
+
+/* The combinators for a DFA parser, from its "/re/" description */
+static mpc_parser_t *mpc_re_dfa_fallback(const char *m) {
+  
+  mpc_parser_t *x;
+  char *re = malloc(strlen(m) - 1);
+  
+  memcpy(re, m + 1, strlen(m) - 2);
+  re[strlen(m) - 2] = '\0';
+  x = mpc_re_combinators(re);
+  free(re);
+  return x;
+}
+
+/*
+** Packrat Memoization
+**
+** Inside mpc_memo the result of every retained
+** parser, which is every named rule, is stored
+** by the position it ran at, so no rule is run
+** twice at the same place. This is what makes a
+** backtracking grammar parse in linear time.
+**
+** Results are handed out as copies made by the
+** user's dup function, and the errors a rule
+** merged on its way are replayed with it. The
+** table has a fixed number of slots, and a new
+** result simply replaces an old one in its slot.
+*/
+
+typedef struct {
+  mpc_parser_t *p;
+  long pos;
+  int flags;
+  int ok;
+  mpc_state_t end;
+  char last;
+  mpc_val_t *output;
+  mpc_err_t *error;
+  mpc_err_t *merged;
+} mpc_memo_entry_t;
+
+typedef struct mpc_memo_t {
+  int slots;
+  mpc_dup_t dup;
+  mpc_dtor_t del;
+  mpc_memo_entry_t *entries;
+} mpc_memo_t;
+
+/* a copy outside of the input's memory pool, as memo entries outlive most values */
+static mpc_err_t *mpc_err_copy(mpc_err_t *x) {
+  
+  mpc_err_t *y;
+  int j;
+  
+  if (x == NULL) { return NULL; }
+  
+  y = malloc(sizeof(mpc_err_t));
+  *y = *x;
+  y->filename = malloc(strlen(x->filename) + 1);
+  strcpy(y->filename, x->filename);
+  y->failure = NULL;
+  if (x->failure) {
+    y->failure = malloc(strlen(x->failure) + 1);
+    strcpy(y->failure, x->failure);
+  }
+  y->expected = x->expected_num ? malloc(sizeof(char*) * x->expected_num) : NULL;
+  for (j = 0; j < x->expected_num; j++) {
+    y->expected[j] = malloc(strlen(x->expected[j]) + 1);
+    strcpy(y->expected[j], x->expected[j]);
+  }
+  return y;
+}
+
+static void mpc_memo_clear(mpc_input_t *i, mpc_memo_entry_t *m) {
+  if (m->p == NULL) { return; }
+  if (m->ok) { i->memo->del(m->output); }
+  mpc_err_delete_internal(i, m->error);
+  mpc_err_delete_internal(i, m->merged);
+  m->p = NULL;
+}
+
+static void mpc_memo_start(mpc_input_t *i, mpc_pdata_memo_t *d) {
+  i->memo = malloc(sizeof(mpc_memo_t));
+  i->memo->slots = d->slots;
+  i->memo->dup = d->dup;
+  i->memo->del = d->del;
+  i->memo->entries = calloc(d->slots, sizeof(mpc_memo_entry_t));
+}
+
+static void mpc_memo_finish(mpc_input_t *i) {
+  int j;
+  for (j = 0; j < i->memo->slots; j++) {
+    mpc_memo_clear(i, &i->memo->entries[j]);
+  }
+  free(i->memo->entries);
+  free(i->memo);
+  i->memo = NULL;
+}
+
+static int mpc_parse_run_type(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e);
+
 static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e) {
   
+  mpc_memo_entry_t *m;
+  mpc_err_t *merged = NULL;
+  long pos = i->state.pos;
+  unsigned long h;
+  int flags, x;
+  
+  if (i->memo == NULL || !p->retained) { return mpc_parse_run_type(i, p, r, e); }
+  
+  /* what a rule does also depends on these modes */
+  flags = (i->suppress ? 1 : 0) | (i->backtrack ? 2 : 0);
+  
+  h = ((unsigned long)(size_t)p >> 4) * 31 + (unsigned long)pos * 2654435761ul + flags;
+  m = &i->memo->entries[h % i->memo->slots];
+  
+  if (m->p == p && m->pos == pos && m->flags == flags) {
+    *e = mpc_err_merge(i, *e, mpc_err_copy(m->merged));
+    if (m->ok) {
+      i->state = m->end;
+      i->last = m->last;
+      r->output = i->memo->dup(m->output);
+    } else {
+      r->error = mpc_err_copy(m->error);
+    }
+    return m->ok;
+  }
+  
+  x = mpc_parse_run_type(i, p, r, &merged);
+  
+  /* the run may have evicted or filled the slot, so take it over here */
+  mpc_memo_clear(i, m);
+  m->p = p;
+  m->pos = pos;
+  m->flags = flags;
+  m->ok = x;
+  m->merged = mpc_err_copy(merged);
+  m->output = NULL;
+  m->error = NULL;
+  
+  if (x) {
+    m->end = i->state;
+    m->last = i->last;
+    m->output = i->memo->dup(r->output);
+  } else {
+    m->error = mpc_err_copy(r->error);
+  }
+  
+  *e = mpc_err_merge(i, *e, merged);
+  return x;
+}
+
+static int mpc_parse_run_type(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_err_t **e) {
+  
   int j = 0, k = 0;
   mpc_result_t results_stk[MPC_PARSE_STACK_MIN];
   mpc_result_t *results;
@@ -995,6 +1461,19 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
     case MPC_TYPE_STRING:  MPC_PRIMITIVE(mpc_input_string(i, p->data.string.x, (char**)&r->output));
     case MPC_TYPE_ANCHOR:  MPC_PRIMITIVE(mpc_input_anchor(i, p->data.anchor.f, (char**)&r->output));
     
+    case MPC_TYPE_SPAN:    MPC_PRIMITIVE(mpc_input_span(i, &p->data.span, (char**)&r->output));
+    
+    case MPC_TYPE_DFA:
+      if (i->type != MPC_INPUT_STRING && i->type != MPC_INPUT_MAPPED) {
+        if (p->data.dfa.x == NULL) { p->data.dfa.x = mpc_re_dfa_fallback(p->data.dfa.m); }
+        return mpc_parse_run(i, p->data.dfa.x, r, e);
+      }
+      if (mpc_input_dfa(i, &p->data.dfa, (char**)&r->output)) {
+        MPC_SUCCESS(r->output);
+      } else {
+        MPC_FAILURE(mpc_err_new(i, p->data.dfa.m));
+      }
+    
     /* Other parsers */
     
     case MPC_TYPE_UNDEFINED: MPC_FAILURE(mpc_err_fail(i, "Parser Undefined!"));
@@ -1030,6 +1509,15 @@ static int mpc_parse_run(mpc_input_t *i, mpc_parser_t *p, mpc_result_t *r, mpc_e
         MPC_FAILURE(mpc_err_new(i, p->data.expect.m));
       }
     
+    case MPC_TYPE_MEMO:
+      if (i->memo || i->type == MPC_INPUT_FILE || p->data.memo.slots <= 0) {
+        return mpc_parse_run(i, p->data.memo.x, r, e);
+      }
+      mpc_memo_start(i, &p->data.memo);
+      j = mpc_parse_run(i, p->data.memo.x, r, e);
+      mpc_memo_finish(i);
+      return j;
+    
     case MPC_TYPE_PREDICT:
       mpc_input_backtrack_disable(i);
       if (mpc_parse_run(i, p->data.predict.x, r, e)) {      
@@ -1223,6 +1711,14 @@ int mpc_parse(const char *filename, const char *string, mpc_parser_t *p, mpc_res
   return x;
 }
 
+int mpc_parse_nstring(const char *filename, const char *string, long length, mpc_parser_t *p, mpc_result_t *r) {
+  int x;
+  mpc_input_t *i = mpc_input_new_nstring(filename, string, length, 1);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
+}
+
 int mpc_parse_file(const char *filename, FILE *file, mpc_parser_t *p, mpc_result_t *r) {
   int x;
   mpc_input_t *i = mpc_input_new_file(filename, file);
@@ -1239,20 +1735,61 @@ int mpc_parse_pipe(const char *filename, FILE *pipe, mpc_parser_t *p, mpc_result
   return x;
 }
 
+/*
+** Read all of fd into a buffer, for files that
+** cannot be mapped.
+*/
+static char *mpc_read_all(int fd, long *length) {
+  
+  long slots = 4096;
+  char *data = malloc(slots);
+  ssize_t n;
+  
+  *length = 0;
+  while (1) {
+    if (*length == slots) {
+      slots = slots * 2;
+      data = realloc(data, slots);
+    }
+    n = read(fd, data + *length, slots - *length);
+    if (n < 0 && errno == EINTR) { continue; }
+    if (n <= 0) { break; }
+    *length += n;
+  }
+  
+  return data;
+}
+
 int mpc_parse_contents(const char *filename, mpc_parser_t *p, mpc_result_t *r) {
   
-  FILE *f = fopen(filename, "rb");
-  int res;
+  int fd = open(filename, O_RDONLY);
+  int x, mapped = 0;
+  struct stat st;
+  long length = 0;
+  char *data = NULL;
+  mpc_input_t *i;
   
-  if (f == NULL) {
+  if (fd < 0) {
     r->output = NULL;
     r->error = mpc_err_file(filename, "Unable to open file!");
     return 0;
   }
   
-  res = mpc_parse_file(filename, f, p, r);
-  fclose(f);
-  return res;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      length = st.st_size;
+      mapped = 1;
+    }
+  }
+  
+  if (!mapped) { data = mpc_read_all(fd, &length); }
+  close(fd);
+  
+  i = mpc_input_new_mapped(filename, data, length, mapped);
+  x = mpc_parse_input(i, p, r);
+  mpc_input_delete(i);
+  return x;
 }
 
 /*
@@ -1299,6 +1836,7 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
     case MPC_TYPE_APPLY:    mpc_undefine_unretained(p->data.apply.x, 0);    break;
     case MPC_TYPE_APPLY_TO: mpc_undefine_unretained(p->data.apply_to.x, 0); break;
     case MPC_TYPE_PREDICT:  mpc_undefine_unretained(p->data.predict.x, 0);  break;
+    case MPC_TYPE_MEMO:     mpc_undefine_unretained(p->data.memo.x, 0);     break;
     
     case MPC_TYPE_MAYBE:
     case MPC_TYPE_NOT:
@@ -1319,6 +1857,19 @@ static void mpc_undefine_unretained(mpc_parser_t *p, int force) {
     case MPC_TYPE_OR:  mpc_undefine_or(p);  break;
     case MPC_TYPE_AND: mpc_undefine_and(p); break;
     
+    case MPC_TYPE_SPAN:
+      free(p->data.span.x);
+      free(p->data.span.set);
+      free(p->data.span.ranges);
+      break;
+    
+    case MPC_TYPE_DFA:
+      if (p->data.dfa.x) { mpc_undefine_unretained(p->data.dfa.x, 0); }
+      free(p->data.dfa.next);
+      free(p->data.dfa.accept);
+      free(p->data.dfa.m);
+      break;
+    
     default: break;
   }
   
@@ -1397,6 +1948,7 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
     case MPC_TYPE_APPLY:    p->data.apply.x    = mpc_copy(a->data.apply.x);    break;
     case MPC_TYPE_APPLY_TO: p->data.apply_to.x = mpc_copy(a->data.apply_to.x); break;
     case MPC_TYPE_PREDICT:  p->data.predict.x  = mpc_copy(a->data.predict.x);  break;
+    case MPC_TYPE_MEMO:     p->data.memo.x     = mpc_copy(a->data.memo.x);     break;
     
     case MPC_TYPE_MAYBE:
     case MPC_TYPE_NOT:
@@ -1432,6 +1984,25 @@ mpc_parser_t *mpc_copy(mpc_parser_t *a) {
       }
     break;
     
+    case MPC_TYPE_SPAN:
+      p->data.span.x = malloc(strlen(a->data.span.x)+1);
+      strcpy(p->data.span.x, a->data.span.x);
+      p->data.span.set = malloc(32);
+      memcpy(p->data.span.set, a->data.span.set, 32);
+      p->data.span.ranges = malloc(a->data.span.n * 2 + 1);
+      memcpy(p->data.span.ranges, a->data.span.ranges, a->data.span.n * 2);
+    break;
+    
+    case MPC_TYPE_DFA:
+      p->data.dfa.x = a->data.dfa.x ? mpc_copy(a->data.dfa.x) : NULL;
+      p->data.dfa.next = malloc(a->data.dfa.n * 256 * sizeof(short));
+      memcpy(p->data.dfa.next, a->data.dfa.next, a->data.dfa.n * 256 * sizeof(short));
+      p->data.dfa.accept = malloc(a->data.dfa.n);
+      memcpy(p->data.dfa.accept, a->data.dfa.accept, a->data.dfa.n);
+      p->data.dfa.m = malloc(strlen(a->data.dfa.m)+1);
+      strcpy(p->data.dfa.m, a->data.dfa.m);
+    break;
+    
     default: break;
   }
 
@@ -1644,6 +2215,48 @@ mpc_parser_t *mpc_noneof(const char *s) {
 
 }
 
+static mpc_parser_t *mpc_span_new(const char *s, int comp, int min) {
+  
+  mpc_parser_t *p = mpc_undefined();
+  unsigned char *set, c;
+  int j, n = 0;
+  
+  p->type = MPC_TYPE_SPAN;
+  p->data.span.x = malloc(strlen(s) + 1);
+  strcpy(p->data.span.x, s);
+  p->data.span.comp = comp;
+  p->data.span.min = min;
+  
+  /* the same characters as mpc_oneof or mpc_noneof, which differ on nul */
+  set = p->data.span.set = malloc(32);
+  memset(set, comp ? 0xFF : 0x00, 32);
+  for (j = 0; s[j]; j++) {
+    c = (unsigned char)s[j];
+    if (comp) { set[c / 8] &= ~(1 << (c % 8)); }
+    else      { set[c / 8] |= 1 << (c % 8); }
+  }
+  if (comp) { set[0] &= ~1; } else { set[0] |= 1; }
+  
+  /* the set as byte ranges, for the vector paths */
+  p->data.span.ranges = malloc(MPC_SPAN_RANGES_MAX * 2);
+  for (j = 0; j < 256; j++) {
+    if (!mpc_span_has(set, j)) { continue; }
+    if (n == MPC_SPAN_RANGES_MAX) { n = 0; break; }
+    p->data.span.ranges[n*2+0] = j;
+    while (j + 1 < 256 && mpc_span_has(set, j + 1)) { j++; }
+    p->data.span.ranges[n*2+1] = j;
+    n++;
+  }
+  p->data.span.n = n;
+  
+  return p;
+}
+
+mpc_parser_t *mpc_span(const char *s) { return mpc_expectf(mpc_span_new(s, 0, 0), "any of '%s'", s); }
+mpc_parser_t *mpc_span1(const char *s) { return mpc_expectf(mpc_span_new(s, 0, 1), "one or more of '%s'", s); }
+mpc_parser_t *mpc_nspan(const char *s) { return mpc_expectf(mpc_span_new(s, 1, 0), "any but '%s'", s); }
+mpc_parser_t *mpc_nspan1(const char *s) { return mpc_expectf(mpc_span_new(s, 1, 1), "one or more but '%s'", s); }
+
 mpc_parser_t *mpc_satisfy(int(*f)(char)) {
   mpc_parser_t *p = mpc_undefined();
   p->type = MPC_TYPE_SATISFY;
@@ -1687,6 +2300,16 @@ mpc_parser_t *mpc_predictive(mpc_parser_t *a) {
   return p;
 }
 
+mpc_parser_t *mpc_memo(mpc_parser_t *a, int slots, mpc_dup_t dup, mpc_dtor_t del) {
+  mpc_parser_t *p = mpc_undefined();
+  p->type = MPC_TYPE_MEMO;
+  p->data.memo.x = a;
+  p->data.memo.slots = slots;
+  p->data.memo.dup = dup;
+  p->data.memo.del = del;
+  return p;
+}
+
 mpc_parser_t *mpc_not_lift(mpc_parser_t *a, mpc_dtor_t da, mpc_ctor_t lf) {
   mpc_parser_t *p = mpc_undefined();
   p->type = MPC_TYPE_NOT;
@@ -1807,7 +2430,7 @@ static int mpc_boundary_anchor(char prev, char next) {
 mpc_parser_t *mpc_boundary(void) { return mpc_expect(mpc_anchor(mpc_boundary_anchor), "boundary"); }
 
 mpc_parser_t *mpc_whitespace(void) { return mpc_expect(mpc_oneof(" \f\n\r\t\v"), "whitespace"); }
-mpc_parser_t *mpc_whitespaces(void) { return mpc_expect(mpc_many(mpcf_strfold, mpc_whitespace()), "spaces"); }
+mpc_parser_t *mpc_whitespaces(void) { return mpc_expect(mpc_span(" \f\n\r\t\v"), "spaces"); }
 mpc_parser_t *mpc_blank(void) { return mpc_expect(mpc_apply(mpc_whitespaces(), mpcf_free), "whitespace"); }
 
 mpc_parser_t *mpc_newline(void) { return mpc_expect(mpc_char('\n'), "newline"); }
@@ -2117,8 +2740,478 @@ static mpc_val_t *mpcf_re_range(mpc_val_t *x) {
   return out;
 }
 
+/*
+** ### Compiling Regular Expressions to a DFA
+**
+** Besides the tree of combinators, mpc_re tries
+** to compile the pattern to a DFA transition
+** table, which matches a token in one tight
+** loop when the input is held in memory.
+**
+** The combinators match greedily and never back
+** into a repetition or a finished alternative,
+** while a DFA finds the longest match. The two
+** agree when every choice in the pattern can be
+** made by looking at the next character alone,
+** so only such patterns are compiled. Anchors,
+** lookaheads, counted repetition and anything
+** larger than the table allows keep using the
+** combinators alone.
+**
+** The table is built from the positions of the
+** pattern (its character classes): each state
+** is the set of positions just matched.
+*/
+
+enum {
+  MPC_RE_EMPTY,
+  MPC_RE_CLASS,
+  MPC_RE_CAT,
+  MPC_RE_ALT,
+  MPC_RE_STAR,
+  MPC_RE_PLUS,
+  MPC_RE_MAYBE
+};
+
+enum {
+  MPC_RE_POSITIONS_MAX = 63,
+  MPC_RE_STATES_MAX = 256
+};
+
+typedef struct { unsigned char x[32]; } mpc_re_set_t;
+
+typedef struct mpc_re_node_t {
+  int type;
+  int pos;
+  struct mpc_re_node_t *a;
+  struct mpc_re_node_t *b;
+  int nullable;
+  uint64_t first;
+  uint64_t last;
+} mpc_re_node_t;
+
+typedef struct {
+  const char *s;
+  int failed;
+  int positions;
+  mpc_re_set_t sets[MPC_RE_POSITIONS_MAX];
+  uint64_t follow[MPC_RE_POSITIONS_MAX];
+} mpc_re_compiler_t;
+
+static void mpc_re_set_add(mpc_re_set_t *x, unsigned char c) { x->x[c / 8] |= 1 << (c % 8); }
+static int mpc_re_set_has(mpc_re_set_t *x, unsigned char c) { return x->x[c / 8] & (1 << (c % 8)); }
+
+static void mpc_re_set_chars(mpc_re_set_t *x, const char *cs) {
+  /* like mpc_oneof, which also matches the terminating nul */
+  mpc_re_set_add(x, '\0');
+  while (*cs) { mpc_re_set_add(x, *cs++); }
+}
+
+static mpc_re_node_t *mpc_re_node(int type, mpc_re_node_t *a, mpc_re_node_t *b) {
+  mpc_re_node_t *n = calloc(1, sizeof(mpc_re_node_t));
+  n->type = type;
+  n->a = a;
+  n->b = b;
+  return n;
+}
+
+static void mpc_re_node_delete(mpc_re_node_t *n) {
+  if (n == NULL) { return; }
+  mpc_re_node_delete(n->a);
+  mpc_re_node_delete(n->b);
+  free(n);
+}
+
+static mpc_re_node_t *mpc_re_class(mpc_re_compiler_t *c, mpc_re_set_t **set) {
+  mpc_re_node_t *n = mpc_re_node(MPC_RE_CLASS, NULL, NULL);
+  if (c->positions == MPC_RE_POSITIONS_MAX) {
+    c->failed = 1;
+    *set = &c->sets[0];
+    return n;
+  }
+  n->pos = c->positions++;
+  memset(&c->sets[n->pos], 0, sizeof(mpc_re_set_t));
+  *set = &c->sets[n->pos];
+  return n;
+}
+
+/* The same range syntax as mpcf_re_range */
+static mpc_re_node_t *mpc_re_compile_range(mpc_re_compiler_t *c, const char *s, size_t len) {
+  
+  mpc_re_set_t *set, any;
+  mpc_re_node_t *n = mpc_re_class(c, &set);
+  size_t i;
+  int comp = s[0] == '^' ? 1 : 0;
+  unsigned int j;
+  const char *tmp;
+  
+  if (len == 0 || (comp && len == 1)) { c->failed = 1; return n; }
+  
+  memset(&any, 0, sizeof(any));
+  
+  for (i = comp; i < len; i++) {
+    if (s[i] == '\\') {
+      tmp = mpc_re_range_escape_char(s[i+1]);
+      if (tmp != NULL) {
+        while (*tmp) { mpc_re_set_add(&any, *tmp++); }
+      } else {
+        mpc_re_set_add(&any, s[i+1]);
+      }
+      i++;
+    } else if (s[i] == '-') {
+      if (i+1 == len || i == 0) {
+        mpc_re_set_add(&any, '-');
+      } else {
+        for (j = (unsigned char)s[i-1]+1; j + 1 <= (unsigned char)s[i+1]; j++) {
+          mpc_re_set_add(&any, j);
+        }
+      }
+    } else {
+      mpc_re_set_add(&any, s[i]);
+    }
+  }
+  
+  /* like mpc_oneof and mpc_noneof, nul is only matched by the first */
+  for (j = 1; j < 256; j++) {
+    if (!mpc_re_set_has(&any, j) != !comp) { mpc_re_set_add(set, j); }
+  }
+  if (!comp) { mpc_re_set_add(set, '\0'); }
+  
+  return n;
+}
+
+static mpc_re_node_t *mpc_re_compile_regex(mpc_re_compiler_t *c);
+
+static mpc_re_node_t *mpc_re_compile_base(mpc_re_compiler_t *c) {
+  
+  mpc_re_set_t *set;
+  mpc_re_node_t *n;
+  const char *start;
+  int j;
+  
+  switch (*c->s) {
+    
+    case '(':
+      c->s++;
+      n = mpc_re_compile_regex(c);
+      if (*c->s != ')') { c->failed = 1; return n; }
+      c->s++;
+      return n;
+    
+    case '[':
+      start = ++c->s;
+      while (*c->s && *c->s != ']') {
+        if (*c->s == '\\' && c->s[1]) { c->s++; }
+        c->s++;
+      }
+      if (*c->s != ']') { c->failed = 1; return mpc_re_node(MPC_RE_EMPTY, NULL, NULL); }
+      n = mpc_re_compile_range(c, start, c->s - start);
+      c->s++;
+      return n;
+    
+    case '\\':
+      c->s++;
+      n = mpc_re_class(c, &set);
+      switch (*c->s) {
+        case 'a': mpc_re_set_add(set, '\a'); break;
+        case 'f': mpc_re_set_add(set, '\f'); break;
+        case 'n': mpc_re_set_add(set, '\n'); break;
+        case 'r': mpc_re_set_add(set, '\r'); break;
+        case 't': mpc_re_set_add(set, '\t'); break;
+        case 'v': mpc_re_set_add(set, '\v'); break;
+        case 'd': mpc_re_set_chars(set, "0123456789"); break;
+        case 's': mpc_re_set_chars(set, " \f\n\r\t\v"); break;
+        case 'w': mpc_re_set_chars(set, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_"); break;
+        /* anchors and lookaheads */
+        case 'b': case 'B': case 'A': case 'Z':
+        case 'D': case 'S': case 'W': case '\0':
+          c->failed = 1;
+          return n;
+        default: mpc_re_set_add(set, *c->s); break;
+      }
+      c->s++;
+      return n;
+    
+    case '^':
+    case '$':
+      c->failed = 1;
+      return mpc_re_node(MPC_RE_EMPTY, NULL, NULL);
+    
+    case '.':
+      c->s++;
+      n = mpc_re_class(c, &set);
+      for (j = 0; j < 256; j++) { mpc_re_set_add(set, j); }
+      return n;
+    
+    default:
+      n = mpc_re_class(c, &set);
+      mpc_re_set_add(set, *c->s++);
+      return n;
+  }
+}
+
+static mpc_re_node_t *mpc_re_compile_factor(mpc_re_compiler_t *c) {
+  mpc_re_node_t *n = mpc_re_compile_base(c);
+  switch (*c->s) {
+    case '*': c->s++; return mpc_re_node(MPC_RE_STAR, n, NULL);
+    case '+': c->s++; return mpc_re_node(MPC_RE_PLUS, n, NULL);
+    case '?': c->s++; return mpc_re_node(MPC_RE_MAYBE, n, NULL);
+    case '{': c->failed = 1; return n;
+    default: return n;
+  }
+}
+
+static mpc_re_node_t *mpc_re_compile_term(mpc_re_compiler_t *c) {
+  mpc_re_node_t *n = NULL, *f;
+  while (!c->failed && *c->s && *c->s != ')' && *c->s != '|') {
+    f = mpc_re_compile_factor(c);
+    n = n == NULL ? f : mpc_re_node(MPC_RE_CAT, n, f);
+  }
+  return n == NULL ? mpc_re_node(MPC_RE_EMPTY, NULL, NULL) : n;
+}
+
+static mpc_re_node_t *mpc_re_compile_regex(mpc_re_compiler_t *c) {
+  mpc_re_node_t *n = mpc_re_compile_term(c);
+  if (!c->failed && *c->s == '|') {
+    c->s++;
+    n = mpc_re_node(MPC_RE_ALT, n, mpc_re_compile_regex(c));
+  }
+  return n;
+}
+
+/* nullable, first and last positions, and what follows each position */
+static void mpc_re_compile_positions(mpc_re_compiler_t *c, mpc_re_node_t *n) {
+  
+  int p;
+  
+  if (n->a) { mpc_re_compile_positions(c, n->a); }
+  if (n->b) { mpc_re_compile_positions(c, n->b); }
+  
+  switch (n->type) {
+    case MPC_RE_EMPTY:
+      n->nullable = 1;
+      break;
+    case MPC_RE_CLASS:
+      n->first = n->last = (uint64_t)1 << n->pos;
+      break;
+    case MPC_RE_CAT:
+      n->nullable = n->a->nullable && n->b->nullable;
+      n->first = n->a->first | (n->a->nullable ? n->b->first : 0);
+      n->last = n->b->last | (n->b->nullable ? n->a->last : 0);
+      for (p = 0; p < c->positions; p++) {
+        if (n->a->last & ((uint64_t)1 << p)) { c->follow[p] |= n->b->first; }
+      }
+      break;
+    case MPC_RE_ALT:
+      n->nullable = n->a->nullable || n->b->nullable;
+      n->first = n->a->first | n->b->first;
+      n->last = n->a->last | n->b->last;
+      break;
+    case MPC_RE_STAR:
+    case MPC_RE_PLUS:
+    case MPC_RE_MAYBE:
+      n->nullable = n->type == MPC_RE_PLUS ? n->a->nullable : 1;
+      n->first = n->a->first;
+      n->last = n->a->last;
+      if (n->type == MPC_RE_MAYBE) { break; }
+      for (p = 0; p < c->positions; p++) {
+        if (n->a->last & ((uint64_t)1 << p)) { c->follow[p] |= n->a->first; }
+      }
+      break;
+  }
+}
+
+static void mpc_re_compile_chars(mpc_re_compiler_t *c, uint64_t positions, mpc_re_set_t *out) {
+  int p, j;
+  memset(out, 0, sizeof(mpc_re_set_t));
+  for (p = 0; p < c->positions; p++) {
+    if (!(positions & ((uint64_t)1 << p))) { continue; }
+    for (j = 0; j < 32; j++) { out->x[j] |= c->sets[p].x[j]; }
+  }
+}
+
+static int mpc_re_compile_disjoint(mpc_re_set_t *x, mpc_re_set_t *y) {
+  int j;
+  for (j = 0; j < 32; j++) { if (x->x[j] & y->x[j]) { return 0; } }
+  return 1;
+}
+
+/*
+** Check every choice in n can be made on the
+** next character, given the characters that
+** can follow n.
+*/
+static int mpc_re_compile_ll1(mpc_re_compiler_t *c, mpc_re_node_t *n, mpc_re_set_t *follow) {
+  
+  mpc_re_set_t x, y;
+  int j;
+  
+  switch (n->type) {
+    
+    case MPC_RE_EMPTY:
+    case MPC_RE_CLASS:
+      return 1;
+    
+    case MPC_RE_CAT:
+      mpc_re_compile_chars(c, n->b->first, &x);
+      if (n->b->nullable) {
+        for (j = 0; j < 32; j++) { x.x[j] |= follow->x[j]; }
+      }
+      return mpc_re_compile_ll1(c, n->a, &x)
+          && mpc_re_compile_ll1(c, n->b, follow);
+    
+    case MPC_RE_ALT:
+      /* an alternative matching nothing hides the ones after it */
+      if (n->a->nullable) { return 0; }
+      mpc_re_compile_chars(c, n->a->first, &x);
+      mpc_re_compile_chars(c, n->b->first, &y);
+      if (n->b->nullable) {
+        for (j = 0; j < 32; j++) { y.x[j] |= follow->x[j]; }
+      }
+      return mpc_re_compile_disjoint(&x, &y)
+          && mpc_re_compile_ll1(c, n->a, follow)
+          && mpc_re_compile_ll1(c, n->b, follow);
+    
+    case MPC_RE_STAR:
+    case MPC_RE_PLUS:
+    case MPC_RE_MAYBE:
+      if (n->a->nullable) { return 0; }
+      mpc_re_compile_chars(c, n->a->first, &x);
+      if (!mpc_re_compile_disjoint(&x, follow)) { return 0; }
+      if (n->type == MPC_RE_MAYBE) { return mpc_re_compile_ll1(c, n->a, follow); }
+      for (j = 0; j < 32; j++) { x.x[j] |= follow->x[j]; }
+      return mpc_re_compile_ll1(c, n->a, &x);
+  }
+  
+  return 0;
+}
+
+/* Subset construction over the positions */
+static int mpc_re_compile_table(mpc_re_compiler_t *c, mpc_re_node_t *root, mpc_pdata_dfa_t *d) {
+  
+  const uint64_t start = (uint64_t)1 << MPC_RE_POSITIONS_MAX;
+  uint64_t states[MPC_RE_STATES_MAX];
+  uint64_t accepts[256];
+  uint64_t reach, next;
+  int n = 1, s, p, k, ch;
+  
+  /* the positions each character is accepted at */
+  memset(accepts, 0, sizeof(accepts));
+  for (p = 0; p < c->positions; p++) {
+    for (ch = 0; ch < 256; ch++) {
+      if (mpc_re_set_has(&c->sets[p], ch)) { accepts[ch] |= (uint64_t)1 << p; }
+    }
+  }
+  
+  d->next = malloc(256 * sizeof(short));
+  d->accept = malloc(MPC_RE_STATES_MAX);
+  states[0] = start;
+  
+  for (s = 0; s < n; s++) {
+    
+    if (states[s] == start) {
+      reach = root->first;
+      d->accept[s] = root->nullable;
+    } else {
+      reach = 0;
+      for (p = 0; p < c->positions; p++) {
+        if (states[s] & ((uint64_t)1 << p)) { reach |= c->follow[p]; }
+      }
+      d->accept[s] = (states[s] & root->last) != 0;
+    }
+    
+    for (ch = 0; ch < 256; ch++) {
+      next = reach & accepts[ch];
+      if (next == 0) { d->next[s * 256 + ch] = -1; continue; }
+      for (k = 0; k < n; k++) { if (states[k] == next) { break; } }
+      if (k == n) {
+        if (n == MPC_RE_STATES_MAX) { return 0; }
+        states[n++] = next;
+        d->next = realloc(d->next, n * 256 * sizeof(short));
+      }
+      d->next[s * 256 + ch] = k;
+    }
+  }
+  
+  d->n = n;
+  d->accept = realloc(d->accept, n);
+  return 1;
+}
+
+/*
+** A DFA parser for re, or NULL if re cannot be
+** compiled. The combinators for inputs that are
+** not in memory are only built if one comes up.
+*/
+static mpc_parser_t *mpc_re_dfa(const char *re) {
+  
+  mpc_re_compiler_t *c = calloc(1, sizeof(mpc_re_compiler_t));
+  mpc_re_set_t none;
+  mpc_re_node_t *root;
+  mpc_parser_t *p;
+  mpc_pdata_dfa_t d;
+  const char *s;
+  int ok;
+  
+  /* ranges over signed chars are left to the combinators */
+  for (s = re; *s; s++) {
+    if ((unsigned char)*s >= 128) { free(c); return NULL; }
+  }
+  
+  c->s = re;
+  root = mpc_re_compile_regex(c);
+  ok = !c->failed && *c->s == '\0';
+  
+  if (ok) {
+    mpc_re_compile_positions(c, root);
+    memset(&none, 0, sizeof(none));
+    ok = mpc_re_compile_ll1(c, root, &none);
+  }
+  
+  d.next = NULL;
+  d.accept = NULL;
+  if (ok) { ok = mpc_re_compile_table(c, root, &d); }
+  
+  mpc_re_node_delete(root);
+  free(c);
+  
+  if (!ok) {
+    free(d.next);
+    free(d.accept);
+    return NULL;
+  }
+  
+  p = mpc_undefined();
+  p->type = MPC_TYPE_DFA;
+  p->data.dfa = d;
+  p->data.dfa.x = NULL;
+  p->data.dfa.m = malloc(strlen(re) + 3);
+  sprintf(p->data.dfa.m, "/%s/", re);
+  return p;
+}
+
+static mpc_parser_t *mpc_re_combinators(const char *re);
+
 mpc_parser_t *mpc_re(const char *re) {
   
+  mpc_parser_t *p;
+  char *s;
+  
+  /* Lone anchors, built as mpc_re_combinators would without parsing them */
+  if (strcmp(re, "^") == 0 || strcmp(re, "$") == 0) {
+    s = malloc(2);
+    strcpy(s, re);
+    p = mpc_and(2, mpcf_strfold, mpc_lift(mpcf_ctor_str), mpcf_re_escape(s), free);
+    mpc_optimise(p);
+    return p;
+  }
+  
+  p = mpc_re_dfa(re);
+  return p ? p : mpc_re_combinators(re);
+}
+
+static mpc_parser_t *mpc_re_combinators(const char *re) {
+  
   char *err_msg;
   mpc_parser_t *err_out;
   mpc_result_t r;
@@ -2509,6 +3602,15 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
     free(s);
   }
   
+  if (p->type == MPC_TYPE_SPAN) {
+    s = mpcf_escape_new(
+      p->data.span.x,
+      mpc_escape_input_c,
+      mpc_escape_output_c);
+    printf(p->data.span.comp ? "[^%s]%c" : "[%s]%c", s, p->data.span.min ? '+' : '*');
+    free(s);
+  }
+  
   if (p->type == MPC_TYPE_STRING) {
     s = mpcf_escape_new(
       p->data.string.x,
@@ -2518,9 +3620,12 @@ static void mpc_print_unretained(mpc_parser_t *p, int force) {
     free(s);
   }
   
+  if (p->type == MPC_TYPE_DFA) { printf("%s", p->data.dfa.m); }
+  
   if (p->type == MPC_TYPE_APPLY)    { mpc_print_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { mpc_print_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { mpc_print_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_MEMO)     { mpc_print_unretained(p->data.memo.x, 0); }
 
   if (p->type == MPC_TYPE_NOT)   { mpc_print_unretained(p->data.not.x, 0); printf("!"); }
   if (p->type == MPC_TYPE_MAYBE) { mpc_print_unretained(p->data.not.x, 0); printf("?"); }
@@ -2714,6 +3819,21 @@ int mpc_ast_eq(mpc_ast_t *a, mpc_ast_t *b) {
   return 1;
 }
 
+mpc_ast_t *mpc_ast_copy(mpc_ast_t *a) {
+  
+  mpc_ast_t *c;
+  int i;
+  
+  if (a == NULL) { return a; }
+  
+  c = mpc_ast_new(a->tag, a->contents);
+  c->state = a->state;
+  for (i = 0; i < a->children_num; i++) {
+    mpc_ast_add_child(c, mpc_ast_copy(a->children[i]));
+  }
+  return c;
+}
+
 mpc_ast_t *mpc_ast_add_child(mpc_ast_t *r, mpc_ast_t *a) {
   r->children_num++;
   r->children = realloc(r->children, sizeof(mpc_ast_t*) * r->children_num);
@@ -3576,6 +4696,7 @@ static int mpc_nodecount_unretained(mpc_parser_t* p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { return 1 + mpc_nodecount_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { return 1 + mpc_nodecount_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { return 1 + mpc_nodecount_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_MEMO)     { return 1 + mpc_nodecount_unretained(p->data.memo.x, 0); }
 
   if (p->type == MPC_TYPE_NOT)   { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
   if (p->type == MPC_TYPE_MAYBE) { return 1 + mpc_nodecount_unretained(p->data.not.x, 0); }
@@ -3623,11 +4744,13 @@ static void mpc_optimise_unretained(mpc_parser_t *p, int force) {
   if (p->type == MPC_TYPE_APPLY)    { mpc_optimise_unretained(p->data.apply.x, 0); }
   if (p->type == MPC_TYPE_APPLY_TO) { mpc_optimise_unretained(p->data.apply_to.x, 0); }
   if (p->type == MPC_TYPE_PREDICT)  { mpc_optimise_unretained(p->data.predict.x, 0); }
+  if (p->type == MPC_TYPE_MEMO)     { mpc_optimise_unretained(p->data.memo.x, 0); }
   if (p->type == MPC_TYPE_NOT)      { mpc_optimise_unretained(p->data.not.x, 0); }
   if (p->type == MPC_TYPE_MAYBE)    { mpc_optimise_unretained(p->data.not.x, 0); }
   if (p->type == MPC_TYPE_MANY)     { mpc_optimise_unretained(p->data.repeat.x, 0); }
   if (p->type == MPC_TYPE_MANY1)    { mpc_optimise_unretained(p->data.repeat.x, 0); }
   if (p->type == MPC_TYPE_COUNT)    { mpc_optimise_unretained(p->data.repeat.x, 0); }
+  if (p->type == MPC_TYPE_DFA && p->data.dfa.x) { mpc_optimise_unretained(p->data.dfa.x, 0); }
   
   if (p->type == MPC_TYPE_OR) { 
     for(i = 0; i < p->data.or.n; i++) {
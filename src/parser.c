@@ -1,8 +1,16 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <sys/stat.h>
+
 #include "mpc.h"
 #include "eval.h"
 #include "types.h"
 #include "parser.h"
 #include "builtin.h"
+#include "reader.h"
+
+int parser_reader = READER_MPC;
+int parser_memo = 0;
 
 mpc_parser_t* Number;
 mpc_parser_t* Symbol;
@@ -13,7 +21,175 @@ mpc_parser_t* Qexpr;
 mpc_parser_t* Expr;
 mpc_parser_t* Program;
 
+/* the same grammar, building values in its folds */
+mpc_parser_t* FoldExpr;
+mpc_parser_t* FoldSexpr;
+mpc_parser_t* FoldQexpr;
+mpc_parser_t* FoldProgram;
+
+static lval* read_num(char* s) {
+    errno = 0;
+    long x = strtol(s, NULL, 10);
+    return errno != ERANGE
+        ? lval_num(x)
+        : lval_err_code(LERR_BAD_NUM);
+}
+
+static void fold_del(mpc_val_t* x) {
+    if (x) { lval_del(x); }
+}
+
+static mpc_val_t* fold_dup(mpc_val_t* x) {
+    return x ? lval_copy(x) : NULL;
+}
+
+static mpc_val_t* fold_num(mpc_val_t* x) {
+    lval* v = read_num(x);
+    free(x);
+    return v;
+}
+
+static mpc_val_t* fold_sym(mpc_val_t* x) {
+    lval* v = lval_sym(x);
+    free(x);
+    return v;
+}
+
+static mpc_val_t* fold_str(mpc_val_t* x) {
+    /* drop the quotes, then unescape in place of the match */
+    char* s = x;
+    s[strlen(s) - 1] = '\0';
+    memmove(s, s+1, strlen(s));
+    s = mpcf_unescape(s);
+    lval* v = lval_str(s);
+    free(s);
+    return v;
+}
+
+static mpc_val_t* fold_comment(mpc_val_t* x) {
+    free(x);
+    return NULL;
+}
+
+/**
+ * cells of a list; comments come through as NULL
+ */
+static mpc_val_t* fold_cells(int n, mpc_val_t** xs) {
+    lval* v = lval_sexpr();
+    for (int i=0; i < n; i++) {
+        if (xs[i]) { lval_add(v, xs[i]); }
+    }
+    return v;
+}
+
+static mpc_val_t* fold_list(int n, mpc_val_t** xs) {
+    free(xs[0]);
+    free(xs[2]);
+    return xs[1];
+}
+
+static mpc_val_t* fold_qexpr(int n, mpc_val_t** xs) {
+    lval* v = fold_list(n, xs);
+    v->type = LVAL_QEXPR;
+    return v;
+}
+
+static void init_fold_parser(void) {
+    FoldExpr    = mpc_new("expr");
+    FoldSexpr   = mpc_new("sexpr");
+    FoldQexpr   = mpc_new("qexpr");
+    FoldProgram = mpc_new("program");
+
+    mpc_parser_t* number  = mpc_apply(mpc_tok(mpc_re("-?[0-9]+")), fold_num);
+    /* runs of characters are spans, so they are read in one step */
+    mpc_parser_t* symbol  = mpc_apply(mpc_tok(mpc_span1(
+        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"
+        "_+-*/\\=<>!&")), fold_sym);
+    mpc_parser_t* string  = mpc_apply(mpc_tok(mpc_and(3, mpcf_strfold,
+        mpc_char('"'),
+        mpc_many(mpcf_strfold, mpc_or(2, mpc_nspan1("\"\\"), mpc_escape())),
+        mpc_char('"'),
+        free, free)), fold_str);
+    mpc_parser_t* comment = mpc_apply(mpc_tok(mpc_and(2, mpcf_strfold,
+        mpc_char(';'), mpc_nspan("\r\n"), free)), fold_comment);
+
+    mpc_define(FoldSexpr, mpc_and(3, fold_list,
+        mpc_sym("("), mpc_many(fold_cells, FoldExpr), mpc_sym(")"),
+        free, fold_del));
+    mpc_define(FoldQexpr, mpc_and(3, fold_qexpr,
+        mpc_sym("{"), mpc_many(fold_cells, FoldExpr), mpc_sym("}"),
+        free, fold_del));
+    mpc_define(FoldExpr, mpc_or(6,
+        mpc_expect(number, "number"), mpc_expect(symbol, "symbol"),
+        mpc_expect(string, "string"), mpc_expect(comment, "comment"),
+        FoldSexpr, FoldQexpr));
+    mpc_define(FoldProgram, mpc_and(3, fold_list,
+        mpc_tok(mpc_soi()), mpc_many(fold_cells, FoldExpr), mpc_eoi(),
+        free, fold_del));
+}
+
+/**
+ * the mpc reader's grammar, built directly rather than by mpca_lang, which
+ * would parse a description of it at every startup. with number, symbol,
+ * string and comment the regexes in init_parser, it is
+ *
+ *     sexpr   : '(' <expr>* ')' ;
+ *     qexpr   : '{' <expr>* '}' ;
+ *     expr    : <number> | <symbol> | <string>
+ *             | <comment> | <sexpr> | <qexpr> ;
+ *     program : /^/ <expr>* /$/ ;
+ *
+ * the helpers below wrap each part exactly as mpca_lang does, so the asts
+ * it produces, their tags and the error messages are all the same.
+ */
+static mpc_parser_t* lang_regex(const char* re) {
+    return mpca_state(mpca_tag(
+        mpc_apply(mpc_tok(mpc_re(re)), mpcf_str_ast), "regex"));
+}
+
+static mpc_parser_t* lang_char(char c) {
+    return mpca_state(mpca_tag(
+        mpc_apply(mpc_tok(mpc_char(c)), mpcf_str_ast), "char"));
+}
+
+static mpc_parser_t* lang_ref(mpc_parser_t* p, const char* name) {
+    return mpca_state(mpca_root(mpca_add_tag(p, name)));
+}
+
+/**
+ * a sequence of n parts, folded one at a time onto mpc_pass
+ */
+static mpc_parser_t* lang_seq(int n, mpc_parser_t** xs) {
+    mpc_parser_t* p = mpc_pass();
+    for (int i=0; i < n; i++) { p = mpca_and(2, p, xs[i]); }
+    return p;
+}
+
+/**
+ * alternatives of one part each, nested to the right
+ */
+static mpc_parser_t* lang_alt(int n, mpc_parser_t** xs) {
+    mpc_parser_t* p = lang_seq(1, &xs[n-1]);
+    for (int i=n-2; i >= 0; i--) { p = mpca_or(2, lang_seq(1, &xs[i]), p); }
+    return p;
+}
+
+static void lang_define(mpc_parser_t* rule, mpc_parser_t* p) {
+    mpc_optimise(p);
+    mpc_define(rule, p);
+}
+
+static mpc_parser_t* lang_list(char open, char close) {
+    mpc_parser_t* xs[] = {
+        lang_char(open),
+        mpca_many(lang_ref(Expr, "expr")),
+        lang_char(close),
+    };
+    return lang_seq(3, xs);
+}
+
 void init_parser(void) {
+    if (Program) { return; }
 
     Number  = mpc_new("number");
     Symbol  = mpc_new("symbol");
@@ -24,38 +200,88 @@ void init_parser(void) {
     Expr    = mpc_new("expr");
     Program = mpc_new("program");
 
-    mpca_lang(MPCA_LANG_DEFAULT,
-            "                                                \
-                number  : /-?[0-9]+/ ;                       \
-                symbol  : /[a-zA-Z0-9_+\\-*\\/\\\\=<>!&]+/ ; \
-                string  : /\"(\\\\.|[^\"])*\"/ ;             \
-                comment : /;[^\\r\\n]*/ ;                    \
-                sexpr   : '(' <expr>* ')' ;                  \
-                qexpr   : '{' <expr>* '}' ;                  \
-                expr    : <number> | <symbol> | <string>     \
-                        | <comment> | <sexpr> | <qexpr> ;    \
-                program : /^/ <expr>* /$/ ;                  \
-            ",
-            Number, Symbol, String, Comment,
-            Sexpr, Qexpr, Expr, Program);
+    mpc_parser_t* number  = lang_regex("-?[0-9]+");
+    mpc_parser_t* symbol  = lang_regex("[a-zA-Z0-9_+\\-*/\\\\=<>!&]+");
+    mpc_parser_t* string  = lang_regex("\"(\\\\.|[^\"\\\\])*\"");
+    mpc_parser_t* comment = lang_regex(";[^\\r\\n]*");
+    lang_define(Number,  lang_seq(1, &number));
+    lang_define(Symbol,  lang_seq(1, &symbol));
+    lang_define(String,  lang_seq(1, &string));
+    lang_define(Comment, lang_seq(1, &comment));
+
+    lang_define(Sexpr, lang_list('(', ')'));
+    lang_define(Qexpr, lang_list('{', '}'));
+
+    mpc_parser_t* exprs[] = {
+        lang_ref(Number, "number"), lang_ref(Symbol, "symbol"),
+        lang_ref(String, "string"), lang_ref(Comment, "comment"),
+        lang_ref(Sexpr, "sexpr"), lang_ref(Qexpr, "qexpr"),
+    };
+    lang_define(Expr, lang_alt(6, exprs));
+
+    mpc_parser_t* program[] = {
+        lang_regex("^"),
+        mpca_many(lang_ref(Expr, "expr")),
+        lang_regex("$"),
+    };
+    lang_define(Program, lang_seq(3, program));
+
+    init_fold_parser();
 }
 
 void free_parser(void) {
+    if (!Program) { return; }
     mpc_cleanup(8,
             Number, Symbol, String, Comment,
             Sexpr, Qexpr, Expr, Program);
+    mpc_cleanup(4, FoldExpr, FoldSexpr, FoldQexpr, FoldProgram);
+    Program = FoldProgram = NULL;
+}
+
+/**
+ * top-level parser for the mpc or fold reader, memoised if parser_memo
+ * asks for it. release it with grammar_done. the grammars are only built
+ * the first time one is needed, so the native reader never pays for them
+ */
+static mpc_parser_t* grammar(void) {
+    init_parser();
+    int fold = parser_reader == READER_FOLD;
+    mpc_parser_t* program = fold ? FoldProgram : Program;
+    if (parser_memo <= 0) { return program; }
+    return fold
+        ? mpc_memo(program, parser_memo, fold_dup, fold_del)
+        : mpc_memo(program, parser_memo,
+            (mpc_dup_t)mpc_ast_copy, (mpc_dtor_t)mpc_ast_delete);
+}
+
+static void grammar_done(mpc_parser_t* p) {
+    if (p != Program && p != FoldProgram) { mpc_delete(p); }
 }
 
 lval* parse(char* input) {
+    if (parser_reader == READER_NATIVE) {
+        lval* x = reader_read("<stdin>", input, strlen(input));
+        if (x->type == LVAL_ERR) {
+            lval_println(x);
+            lval_del(x);
+            return NULL;
+        }
+        return x;
+    }
+
     mpc_result_t r;
     lval* x = NULL;
-    if (mpc_parse("<stdin>", input, Program, &r)) {
-        x = lval_read(r.output);
-        mpc_ast_delete(r.output);
-    } else {
+    mpc_parser_t* program = grammar();
+    if (!mpc_parse_nstring("<stdin>", input, strlen(input), program, &r)) {
         mpc_err_print(r.error);
         mpc_err_delete(r.error);
+    } else if (parser_reader == READER_FOLD) {
+        x = r.output;
+    } else {
+        x = lval_read(r.output);
+        mpc_ast_delete(r.output);
     }
+    grammar_done(program);
     return x;
 }
 
@@ -63,7 +289,9 @@ void parse_args(lenv* e, int argc, char** argv) {
     if (argc >= 2) {
         for (int i=1; i<argc; i++) {
             lval* args = lval_add(lval_sexpr(), lval_str(argv[i]));
+            lbudget_start();
             lval* x = builtin_load(e, args);
+            lbudget_stop();
 
             if (x->type == LVAL_ERR) { lval_println(x); }
             lval_del(x);
@@ -75,11 +303,7 @@ void parse_args(lenv* e, int argc, char** argv) {
  * convert ast to number
  */
 lval* lval_read_num(mpc_ast_t* t) {
-    errno = 0;
-    long x = strtol(t->contents, NULL, 10);
-    return errno != ERANGE
-        ? lval_num(x)
-        : lval_err("invalid number");
+    return read_num(t->contents);
 }
 
 lval* lval_read_str(mpc_ast_t* t) {
@@ -95,9 +319,61 @@ lval* lval_read_str(mpc_ast_t* t) {
     return str;
 }
 
+/**
+ * whole file in a malloc'd buffer
+ */
+static char* read_file(char* filename, long* len) {
+    FILE* f = fopen(filename, "rb");
+    if (!f) { return NULL; }
+
+    /* only regular files have a size to go by; not pipes or directories */
+    struct stat st;
+    long size = -1;
+    if (fstat(fileno(f), &st) == 0 && S_ISREG(st.st_mode) &&
+            fseek(f, 0, SEEK_END) == 0) {
+        size = ftell(f);
+    }
+    char* buf = size >= 0 && fseek(f, 0, SEEK_SET) == 0
+        ? malloc(size+1)
+        : NULL;
+    if (buf) {
+        *len = fread(buf, 1, size, f);
+        if (ferror(f)) {
+            free(buf);
+            buf = NULL;
+        } else {
+            buf[*len] = '\0';
+        }
+    }
+    fclose(f);
+    return buf;
+}
+
 lval* lval_read_file(char* filename) {
+    if (parser_reader == READER_NATIVE) {
+        long len;
+        char* input = read_file(filename, &len);
+        if (!input) { return lval_err("could not load library %s", filename); }
+
+        lval* x = reader_read(filename, input, len);
+        free(input);
+        if (x->type == LVAL_ERR) {
+            lval* err = lval_err("could not load library %s", x->err);
+            lval_del(x);
+            return err;
+        }
+        return x;
+    }
+
     mpc_result_t r;
-    if (mpc_parse_contents(filename, Program, &r)) {
+    int fold = parser_reader == READER_FOLD;
+    mpc_parser_t* program = grammar();
+    int ok = strcmp(filename, "-") == 0
+        ? mpc_parse_pipe("<stdin>", stdin, program, &r)
+        : mpc_parse_contents(filename, program, &r);
+    grammar_done(program);
+    if (ok) {
+        if (fold) { return r.output; }
         lval* x = lval_read(r.output);
         mpc_ast_delete(r.output);
         return x;
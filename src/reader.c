@@ -0,0 +1,393 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "reader.h"
+
+/**
+ * native reader
+ *
+ * reads the same syntax as the mpc grammar in parser.c, in one pass over
+ * the bytes and without building an ast first. number, symbol, string and
+ * comment follow the grammar's regexes exactly, including how they split
+ * runs like "12abc" or "-x". malformed numbers become error values inside
+ * the result, as they do when reading the ast; anything the grammar would
+ * reject is a read error instead.
+ *
+ * input comes through a buffer that is refilled from a file descriptor.
+ * only whole top-level forms are read, so the buffer only ever needs to
+ * hold the largest of them, not the whole file.
+ */
+
+typedef struct {
+    char* name;
+    char* start;
+    char* pos;
+    char* end;
+    lval* err;
+    /* position of start, for error messages */
+    int line;
+    int col;
+} reader;
+
+struct lstream {
+    reader r;
+    char* buf;
+    long cap;
+    int fd;
+    int eof;
+    int failed;
+    /* errno of a failed read, 0 if none */
+    int read_errno;
+};
+
+#define LSTREAM_BUF 65536
+
+static int is_space(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+        c == '\f' || c == '\v';
+}
+
+static int is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static int is_symbol_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        is_digit(c) || (c && strchr("_+-*/\\=<>!&", c));
+}
+
+static void skip_space(reader* r) {
+    while (r->pos < r->end) {
+        if (*r->pos == ';') {
+            while (r->pos < r->end && *r->pos != '\n' && *r->pos != '\r') {
+                r->pos++;
+            }
+        } else if (is_space(*r->pos)) {
+            r->pos++;
+        } else {
+            break;
+        }
+    }
+}
+
+/**
+ * record a read error at the current position
+ */
+static void count_lines(char* s, char* end, int* line, int* col) {
+    for (; s < end; s++) {
+        if (*s == '\n') { (*line)++; *col = 1; } else { (*col)++; }
+    }
+}
+
+static lval* read_error(reader* r, char* expected) {
+    int line = r->line, col = r->col;
+    count_lines(r->start, r->pos, &line, &col);
+
+    if (r->pos >= r->end) {
+        r->err = lval_err("%s:%i:%i: error: expected %s at end of input",
+            r->name, line, col, expected);
+    } else {
+        r->err = lval_err("%s:%i:%i: error: expected %s at '%c'",
+            r->name, line, col, expected, *r->pos);
+    }
+    return NULL;
+}
+
+static lval* read_num(reader* r) {
+    char* s = r->pos;
+    int neg = *s == '-';
+    if (neg) { s++; }
+
+    long x = 0;
+    int range = 0;
+    for (; s < r->end && is_digit(*s); s++) {
+        int d = *s - '0';
+        if (neg) {
+            if (x < (LONG_MIN + d) / 10) { range = 1; } else { x = x*10 - d; }
+        } else {
+            if (x > (LONG_MAX - d) / 10) { range = 1; } else { x = x*10 + d; }
+        }
+    }
+    r->pos = s;
+    return range ? lval_err_code(LERR_BAD_NUM) : lval_num(x);
+}
+
+static lval* read_sym(reader* r) {
+    char* s = r->pos;
+    while (r->pos < r->end && is_symbol_char(*r->pos)) { r->pos++; }
+
+    int n = r->pos - s;
+    char buf[64];
+    char* sym = n < (int)sizeof(buf) ? buf : malloc(n+1);
+    memcpy(sym, s, n);
+    sym[n] = '\0';
+
+    lval* v = lval_sym(sym);
+    if (sym != buf) { free(sym); }
+    return v;
+}
+
+static char unescape(char c) {
+    switch (c) {
+        case 'a': return '\a';
+        case 'b': return '\b';
+        case 'f': return '\f';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 't': return '\t';
+        case 'v': return '\v';
+        case '\\': return '\\';
+        case '\'': return '\'';
+        case '"': return '"';
+    }
+    return 0;
+}
+
+static lval* read_str(reader* r) {
+    char* s = ++r->pos;
+    while (r->pos < r->end && *r->pos != '"') {
+        if (*r->pos == '\\') { r->pos++; }
+        r->pos++;
+    }
+    if (r->pos >= r->end) {
+        r->pos = r->end;
+        return read_error(r, "'\"'");
+    }
+    char* e = r->pos++;
+
+    /* unescaping only ever shortens */
+    char* str = malloc(e - s + 1);
+    int n = 0;
+    for (; s < e; s++) {
+        char c;
+        if (*s == '\\' && (c = unescape(s[1]))) {
+            str[n++] = c;
+            s++;
+        } else if (*s == '\\' && s[1] == '0') {
+            /* as mpcf_unescape, an escaped nul is dropped */
+            s++;
+        } else {
+            str[n++] = *s;
+        }
+    }
+    str[n] = '\0';
+
+    lval* v = lval_str(str);
+    free(str);
+    return v;
+}
+
+static lval* read_expr(reader* r);
+
+static lval* read_cells(reader* r, lval* x, char close) {
+    r->pos++;
+    while (1) {
+        skip_space(r);
+        if (r->pos >= r->end) {
+            lval_del(x);
+            return read_error(r, close == ')' ? "')'" : "'}'");
+        }
+        if (*r->pos == close) {
+            r->pos++;
+            return x;
+        }
+        lval* y = read_expr(r);
+        if (!y) {
+            lval_del(x);
+            return NULL;
+        }
+        lval_add(x, y);
+    }
+}
+
+static lval* read_expr(reader* r) {
+    if (r->pos >= r->end) { return read_error(r, "expression"); }
+
+    char* s = r->pos;
+    switch (*s) {
+        case '(': return read_cells(r, lval_sexpr(), ')');
+        case '{': return read_cells(r, lval_qexpr(), '}');
+        case '"': return read_str(r);
+    }
+    if (is_digit(*s) || (*s == '-' && s+1 < r->end && is_digit(s[1]))) {
+        return read_num(r);
+    }
+    if (is_symbol_char(*s)) { return read_sym(r); }
+    return read_error(r, "expression");
+}
+
+/**
+ * end of the top-level form at s, or NULL if it may carry on past end.
+ * only finds where the form stops; read_expr decides if it is well formed
+ */
+static char* scan_form(char* s, char* end, int eof) {
+    if (*s == '(' || *s == '{') {
+        int depth = 0;
+        while (s < end) {
+            char c = *s++;
+            if (c == ';') {
+                while (s < end && *s != '\n' && *s != '\r') { s++; }
+            } else if (c == '"') {
+                while (s < end && *s != '"') {
+                    if (*s == '\\') { s++; }
+                    s++;
+                }
+                s++;
+            } else if (c == '(' || c == '{') {
+                depth++;
+            } else if (c == ')' || c == '}') {
+                if (--depth == 0) { return s; }
+            }
+        }
+        return eof ? end : NULL;
+    }
+    if (*s == '"') {
+        for (s++; s < end && *s != '"'; s++) {
+            if (*s == '\\') { s++; }
+        }
+        if (s < end) { return s+1; }
+        return eof ? end : NULL;
+    }
+    if (is_symbol_char(*s)) {
+        while (s < end && is_symbol_char(*s)) { s++; }
+        return s < end || eof ? s : NULL;
+    }
+    return s+1;
+}
+
+/**
+ * skip space and comments between top-level forms. returns 0 if a
+ * comment runs past the end of the buffer
+ */
+static int skip_between(lstream* s) {
+    reader* r = &s->r;
+    while (r->pos < r->end) {
+        if (*r->pos == ';') {
+            char* c = r->pos;
+            while (c < r->end && *c != '\n' && *c != '\r') { c++; }
+            if (c == r->end && !s->eof) { return 0; }
+            r->pos = c;
+        } else if (is_space(*r->pos)) {
+            r->pos++;
+        } else {
+            break;
+        }
+    }
+    return 1;
+}
+
+/**
+ * move unread input to the front of the buffer and read more after it
+ */
+static void refill(lstream* s) {
+    reader* r = &s->r;
+    long keep = r->end - r->pos;
+
+    count_lines(r->start, r->pos, &r->line, &r->col);
+    memmove(s->buf, r->pos, keep);
+
+    /* a form that fills the buffer gets a bigger one, read in full so
+     * that it is not rescanned for every small read */
+    int grow = keep * 2 > s->cap;
+    if (keep == s->cap) {
+        s->cap *= 2;
+        s->buf = realloc(s->buf, s->cap);
+    }
+
+    long len = keep;
+    while (len < s->cap) {
+        ssize_t n = read(s->fd, s->buf + len, s->cap - len);
+        if (n < 0 && errno == EINTR) { continue; }
+        if (n < 0) { s->read_errno = errno; }
+        if (n <= 0) { s->eof = 1; break; }
+        len += n;
+        if (!grow) { break; }
+    }
+
+    r->start = r->pos = s->buf;
+    r->end = s->buf + len;
+}
+
+lstream* lstream_fdopen(char* name, int fd) {
+    lstream* s = malloc(sizeof(lstream));
+    s->cap = LSTREAM_BUF;
+    s->buf = malloc(s->cap);
+    s->fd = fd;
+    s->eof = 0;
+    s->failed = 0;
+    s->read_errno = 0;
+    s->r = (reader){ name, s->buf, s->buf, s->buf, NULL, 1, 1 };
+    return s;
+}
+
+lstream* lstream_open(char* filename) {
+    if (strcmp(filename, "-") == 0) { return lstream_fdopen("<stdin>", 0); }
+
+    int fd = open(filename, O_RDONLY);
+    return fd < 0 ? NULL : lstream_fdopen(filename, fd);
+}
+
+void lstream_close(lstream* s) {
+    if (s->fd > 0) { close(s->fd); }
+    free(s->buf);
+    free(s);
+}
+
+lval* lstream_next(lstream* s, lval** err) {
+    reader* r = &s->r;
+    *err = NULL;
+    if (s->failed) { return NULL; }
+
+    char* end;
+    while (1) {
+        if (skip_between(s)) {
+            if (r->pos == r->end && s->eof) { return NULL; }
+            if (r->pos < r->end && (end = scan_form(r->pos, r->end, s->eof))) {
+                break;
+            }
+        }
+        refill(s);
+        if (s->read_errno) {
+            s->failed = 1;
+            *err = lval_err("%s: %s", r->name, strerror(s->read_errno));
+            return NULL;
+        }
+    }
+
+    /* the whole form is in the buffer; read no further than it */
+    char* buf_end = r->end;
+    r->end = end;
+    lval* x = read_expr(r);
+    r->end = buf_end;
+
+    if (!x) {
+        s->failed = 1;
+        *err = r->err;
+    }
+    return x;
+}
+
+lval* reader_read(char* name, char* input, long len) {
+    lstream s = { { name, input, input, input + len, NULL, 1, 1 },
+        input, len, -1, 1, 0, 0 };
+
+    lval* x = lval_sexpr();
+    lval* err;
+    lval* y;
+    while ((y = lstream_next(&s, &err))) {
+        lval_add(x, y);
+    }
+    if (err) {
+        lval_del(x);
+        return err;
+    }
+    return x;
+}
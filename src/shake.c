@@ -0,0 +1,213 @@
+#include <string.h>
+
+#include "types.h"
+#include "parser.h"
+#include "shake.h"
+
+/**
+ * dead definition elimination
+ *
+ * top-level forms are either definitions, (fun {f ...} {...}) or a def
+ * whose values cannot have side effects, or entry forms, which are
+ * everything else. entry forms are always kept. a definition is kept once
+ * any name it defines is mentioned by something already kept, counting
+ * symbols inside q-expressions, since those are bodies waiting to be
+ * evaluated. this over-approximates: a symbol that only appears as data
+ * still keeps its definition alive.
+ */
+
+static int set_has(lval* set, char* sym) {
+    for (int i=0; i < set->count; i++) {
+        if (strcmp(set->cell[i]->sym, sym) == 0) { return 1; }
+    }
+    return 0;
+}
+
+static void set_add(lval* set, char* sym) {
+    if (!set_has(set, sym)) { lval_add(set, lval_sym(sym)); }
+}
+
+/**
+ * add every symbol mentioned in v to set
+ */
+static void shake_syms(lval* v, lval* set) {
+    switch (v->type) {
+        case LVAL_SYM: set_add(set, v->sym); break;
+        case LVAL_SEXPR:
+        case LVAL_QEXPR:
+            for (int i=0; i < v->count; i++) { shake_syms(v->cell[i], set); }
+            break;
+        case LVAL_FUN:
+            if (!v->builtin) {
+                shake_syms(v->formals, set);
+                shake_syms(v->body, set);
+                for (int i=0; i < v->env->count; i++) {
+                    shake_syms(v->env->vals[i], set);
+                }
+            }
+            break;
+    }
+}
+
+static int is_sym(lval* v, char* sym) {
+    return v->type == LVAL_SYM && strcmp(v->sym, sym) == 0;
+}
+
+/**
+ * evaluating v cannot do anything but produce a value
+ */
+static int is_pure(lval* v) {
+    if (v->type != LVAL_SEXPR) { return 1; }
+    return v->count == 3 && is_sym(v->cell[0], "\\");
+}
+
+/**
+ * names defined by a definition form, or NULL for an entry form
+ */
+static lval* shake_defines(lval* form) {
+    if (form->type != LVAL_SEXPR || form->count < 3) { return NULL; }
+
+    lval* head = form->cell[0];
+    lval* syms = form->cell[1];
+    if (syms->type != LVAL_QEXPR || syms->count == 0) { return NULL; }
+    for (int i=0; i < syms->count; i++) {
+        if (syms->cell[i]->type != LVAL_SYM) { return NULL; }
+    }
+
+    lval* names = lval_qexpr();
+    if (is_sym(head, "fun") && form->count == 3 &&
+            form->cell[2]->type == LVAL_QEXPR) {
+        lval_add(names, lval_copy(syms->cell[0]));
+        return names;
+    }
+    if (is_sym(head, "def") && form->count - 2 == syms->count) {
+        for (int i=2; i < form->count; i++) {
+            if (!is_pure(form->cell[i])) { lval_del(names); return NULL; }
+        }
+        for (int i=0; i < syms->count; i++) {
+            lval_add(names, lval_copy(syms->cell[i]));
+        }
+        return names;
+    }
+    lval_del(names);
+    return NULL;
+}
+
+/**
+ * read files into one list of forms, splicing in (load "file") forms
+ */
+static lval* shake_read(lval* forms, char* file, lval* seen) {
+    if (set_has(seen, file)) { return forms; }
+    set_add(seen, file);
+
+    lval* x = lval_read_file(file);
+    if (x->type == LVAL_ERR) {
+        lval_del(forms);
+        return x;
+    }
+    while (x->count) {
+        lval* form = lval_pop(x, 0);
+        if (form->type == LVAL_SEXPR && form->count == 2 &&
+                is_sym(form->cell[0], "load") &&
+                form->cell[1]->type == LVAL_STR) {
+            forms = shake_read(forms, form->cell[1]->str, seen);
+            lval_del(form);
+            if (forms->type == LVAL_ERR) { break; }
+        } else {
+            lval_add(forms, form);
+        }
+    }
+    lval_del(x);
+    return forms;
+}
+
+/**
+ * write the forms of files that are needed to run them to outfile
+ */
+lval* shake_bundle(char* outfile, int nfiles, char** files) {
+    lval* forms = lval_sexpr();
+    lval* seen = lval_qexpr();
+    for (int i=0; i < nfiles && forms->type != LVAL_ERR; i++) {
+        forms = shake_read(forms, files[i], seen);
+    }
+    lval_del(seen);
+    if (forms->type == LVAL_ERR) { return forms; }
+
+    int n = forms->count;
+    lval** defines = lalloc(sizeof(lval*) * n);
+    int* keep = lalloc(sizeof(int) * n);
+
+    lval* reached = lval_qexpr();
+    for (int i=0; i < n; i++) {
+        defines[i] = shake_defines(forms->cell[i]);
+        keep[i] = defines[i] == NULL;
+        if (keep[i]) { shake_syms(forms->cell[i], reached); }
+    }
+
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (int i=0; i < n; i++) {
+            if (keep[i]) { continue; }
+            for (int j=0; j < defines[i]->count; j++) {
+                if (set_has(reached, defines[i]->cell[j]->sym)) {
+                    keep[i] = 1;
+                    break;
+                }
+            }
+            if (keep[i]) {
+                shake_syms(forms->cell[i], reached);
+                changed = 1;
+            }
+        }
+    }
+
+    lval* result;
+    FILE* out = fopen(outfile, "w");
+    if (out) {
+        for (int i=0; i < n; i++) {
+            if (!keep[i]) { continue; }
+            lval_fprint(out, forms->cell[i]);
+            putc('\n', out);
+        }
+        fclose(out);
+        result = lval_sexpr();
+    } else {
+        result = lval_err("could not open %s for writing", outfile);
+    }
+
+    for (int i=0; i < n; i++) {
+        if (defines[i]) { lval_del(defines[i]); }
+    }
+    lfree(defines);
+    lfree(keep);
+    lval_del(reached);
+    lval_del(forms);
+    return result;
+}
+
+/**
+ * names bound in the global environment e that forms can reach
+ */
+lval* shake_env(lenv* e, lval* forms) {
+    while (e->par) { e = e->par; }
+
+    lval* reached = lval_qexpr();
+    shake_syms(forms, reached);
+
+    /* each pass picks up bindings named by the previous one */
+    int before = -1;
+    while (before != reached->count) {
+        before = reached->count;
+        for (int i=0; i < e->count; i++) {
+            if (set_has(reached, e->syms[i])) {
+                shake_syms(e->vals[i], reached);
+            }
+        }
+    }
+    return reached;
+}
+
+int shake_has(lval* names, char* sym) {
+    return set_has(names, sym);
+}
@@ -6,46 +6,117 @@
 #include "mpc.h"
 #include "types.h"
 
+/**
+ * every lval and lenv allocation goes through here so that live and peak
+ * usage can be tracked. the quota is a soft limit: it is checked by the
+ * evaluator between steps, which turns an overrun into an error that
+ * unwinds normally, so usage can pass it by what one step allocates
+ */
+typedef union {
+    size_t size;
+    long double align;
+} lmem_head;
+
+static size_t lmem_used = 0;
+static size_t lmem_peak = 0;
+static size_t lmem_limit = 0;
+
+static void lmem_count(size_t n) {
+    lmem_used += n;
+    if (lmem_used > lmem_peak) { lmem_peak = lmem_used; }
+}
+
+void* lalloc(size_t n) {
+    lmem_head* h = malloc(sizeof(lmem_head) + n);
+    if (!h) { abort(); }
+    h->size = n;
+    lmem_count(n);
+    return h + 1;
+}
+
+void* lrealloc(void* p, size_t n) {
+    if (!p) { return lalloc(n); }
+    lmem_head* h = (lmem_head*)p - 1;
+    lmem_used -= h->size;
+    h = realloc(h, sizeof(lmem_head) + n);
+    if (!h) { abort(); }
+    h->size = n;
+    lmem_count(n);
+    return h + 1;
+}
+
+void lfree(void* p) {
+    if (!p) { return; }
+    lmem_head* h = (lmem_head*)p - 1;
+    lmem_used -= h->size;
+    free(h);
+}
+
+void lmem_set_quota(size_t bytes) { lmem_limit = bytes; }
+size_t lmem_quota(void) { return lmem_limit; }
+size_t lmem_current(void) { return lmem_used; }
+size_t lmem_max(void) { return lmem_peak; }
+int lmem_exceeded(void) { return lmem_limit && lmem_used > lmem_limit; }
+
 lval* lval_num(long x) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lalloc(sizeof(lval));
     v->type = LVAL_NUM;
     v->num = x;
     return v;
 }
 
 lval* lval_err(char* fmt, ...) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lalloc(sizeof(lval));
     v->type = LVAL_ERR;
+    v->num = LERR_OTHER;
 
+    char buf[512];
     va_list va;
     va_start(va, fmt);
-
-    v->err = malloc(512);
-    vsnprintf(v->err, 511, fmt, va);
-
-    v->err = realloc(v->err, strlen(v->err)+1);
+    vsnprintf(buf, sizeof(buf), fmt, va);
     va_end(va);
+
+    v->err = lalloc(strlen(buf)+1);
+    strcpy(v->err, buf);
     return v;
 }
 
+/**
+ * errors with fixed messages. these are never allocated, copied or freed
+ */
+static lval lval_errs[LERR_COUNT] = {
+    { .type = LVAL_ERR, .num = LERR_DIV_ZERO, .err = "division by zero" },
+    { .type = LVAL_ERR, .num = LERR_BAD_NUM,  .err = "invalid number" },
+    { .type = LVAL_ERR, .num = LERR_BAD_FORMALS,
+      .err = "function format invalid. '&' must be followed by at least one symbol" },
+    { .type = LVAL_ERR, .num = LERR_STEPS,     .err = "evaluation step limit exceeded" },
+    { .type = LVAL_ERR, .num = LERR_TIMEOUT,   .err = "evaluation deadline exceeded" },
+    { .type = LVAL_ERR, .num = LERR_CANCELLED, .err = "evaluation cancelled" },
+    { .type = LVAL_ERR, .num = LERR_NO_MEM,    .err = "memory quota exceeded" },
+};
+
+lval* lval_err_code(int code) {
+    return &lval_errs[code];
+}
+
 lval* lval_sym(char* s) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lalloc(sizeof(lval));
     v->type = LVAL_SYM;
-    v->sym = malloc(strlen(s) + 1);
+    v->sym = lalloc(strlen(s) + 1);
     strcpy(v->sym, s);
     return v;
 }
 
 lval* lval_str(char* s) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lalloc(sizeof(lval));
     v->type = LVAL_STR;
-    v->str = malloc(strlen(s) + 1);
+    v->str = lalloc(strlen(s) + 1);
     strcpy(v->str, s);
     return v;
 }
 
 lval* lval_sexpr(void) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lalloc(sizeof(lval));
     v->type = LVAL_SEXPR;
     v->count = 0;
     v->cell = NULL;
@@ -53,7 +124,7 @@ lval* lval_sexpr(void) {
 }
 
 lval* lval_qexpr(void) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lalloc(sizeof(lval));
     v->type = LVAL_QEXPR;
     v->count = 0;
     v->cell = NULL;
@@ -61,35 +132,52 @@ lval* lval_qexpr(void) {
 }
 
 lval* lval_fun(lbuiltin func) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lalloc(sizeof(lval));
     v->type = LVAL_FUN;
     v->builtin = func;
     return v;
 }
 
 lval* lval_lambda(lval* formals, lval* body) {
-    lval* v = malloc(sizeof(lval));
+    lval* v = lalloc(sizeof(lval));
     v->type = LVAL_FUN;
 
     v->builtin = NULL;
     v->env = lenv_new();
 
+    /* formals and body are shared by all copies and never modified */
     v->formals = formals;
     v->body = body;
+    formals->refs = 1;
+    body->refs = 1;
+
+    v->arity = formals->count;
+    v->variadic = 0;
+    body->numeric = 0;
+    body->native = NULL;
+    for (int i=0; i < formals->count; i++) {
+        if (strcmp(formals->cell[i]->sym, "&") == 0) {
+            v->arity = i;
+            v->variadic = 1;
+            break;
+        }
+    }
     return v;
 }
 
 void lval_del(lval* v) {
     switch (v->type) {
         case LVAL_NUM: break;
-        case LVAL_ERR: free(v->err); break;
-        case LVAL_SYM: free(v->sym); break;
-        case LVAL_STR: free(v->str); break;
+        case LVAL_ERR:
+            if (v->num != LERR_OTHER) { return; }
+            lfree(v->err); break;
+        case LVAL_SYM: lfree(v->sym); break;
+        case LVAL_STR: lfree(v->str); break;
         case LVAL_FUN:
             if (!v->builtin) {
                 lenv_del(v->env);
-                lval_del(v->formals);
-                lval_del(v->body);
+                if (--v->formals->refs == 0) { lval_del(v->formals); }
+                if (--v->body->refs == 0) { lval_del(v->body); }
             }
             break;
         case LVAL_SEXPR:
@@ -97,13 +185,15 @@ void lval_del(lval* v) {
             for (int i=0; i<v->count; i++) {
                 lval_del(v->cell[i]);
             }
-            free(v->cell); break;
+            lfree(v->cell); break;
     }
-    free(v);
+    lfree(v);
 }
 
 lval* lval_copy(lval* v) {
-    lval* x = malloc(sizeof(lval));
+    if (v->type == LVAL_ERR && v->num != LERR_OTHER) { return v; }
+
+    lval* x = lalloc(sizeof(lval));
     x->type = v->type;
 
     switch (v->type) {
@@ -111,21 +201,22 @@ lval* lval_copy(lval* v) {
         case LVAL_NUM: x->num = v->num; break;
 
         case LVAL_ERR:
-            x->err = malloc(strlen(v->err)+1);
+            x->num = LERR_OTHER;
+            x->err = lalloc(strlen(v->err)+1);
             strcpy(x->err, v->err); break;
 
         case LVAL_SYM:
-            x->sym = malloc(strlen(v->sym)+1);
+            x->sym = lalloc(strlen(v->sym)+1);
             strcpy(x->sym, v->sym); break;
 
         case LVAL_STR:
-            x->str = malloc(strlen(v->str)+1);
+            x->str = lalloc(strlen(v->str)+1);
             strcpy(x->str, v->str); break;
 
         case LVAL_SEXPR:
         case LVAL_QEXPR:
             x->count = v->count;
-            x->cell = malloc(sizeof(lval*) * x->count);
+            x->cell = lalloc(sizeof(lval*) * x->count);
             for (int i=0; i < x->count; i++) {
                 x->cell[i] = lval_copy(v->cell[i]);
             }
@@ -136,8 +227,12 @@ lval* lval_copy(lval* v) {
             } else {
                 x->builtin = NULL;
                 x->env = lenv_copy(v->env);
-                x->formals = lval_copy(v->formals);
-                x->body = lval_copy(v->body);
+                x->formals = v->formals;
+                x->body = v->body;
+                x->formals->refs++;
+                x->body->refs++;
+                x->arity = v->arity;
+                x->variadic = v->variadic;
             }
             break;
     }
@@ -176,7 +271,7 @@ int lval_eq(lval* x, lval* y) {
  */
 lval* lval_add(lval* v, lval* x) {
     v->count++;
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+    v->cell = lrealloc(v->cell, sizeof(lval*) * v->count);
     v->cell[v->count-1] = x;
     return v;
 }
@@ -191,7 +286,7 @@ lval* lval_pop(lval* v, int i) {
     memmove(&v->cell[i], &v->cell[i+1], sizeof(lval*) * (v->count-i-1));
 
     v->count--;
-    v->cell = realloc(v->cell, sizeof(lval*) * v->count);
+    v->cell = lrealloc(v->cell, sizeof(lval*) * v->count);
     return x;
 }
 
@@ -215,44 +310,59 @@ lval* lval_join(lval* x, lval* y) {
     return x;
 }
 
-void lval_expr_print(lval* v, char open, char close){
-    putchar(open);
-    for (int i=0; i<v->count; i++) {
-        lval_print(v->cell[i]);
+void lval_expr_print(FILE* f, lval* v, char open, char close){
+    lval_expr_print_from(f, v, 0, open, close);
+}
+
+/**
+ * print the cells of v from index start on
+ */
+void lval_expr_print_from(FILE* f, lval* v, int start, char open, char close){
+    putc(open, f);
+    for (int i=start; i<v->count; i++) {
+        lval_fprint(f, v->cell[i]);
         if (i != (v->count-1)) {
-            putchar(' ');
+            putc(' ', f);
         }
     }
-    putchar(close);
+    putc(close, f);
 }
 
-void lval_string_print(lval* v) {
+void lval_string_print(FILE* f, lval* v) {
     char* escaped = malloc(strlen(v->str) + 1);
     strcpy(escaped, v->str);
     escaped = mpcf_escape(escaped);
-    printf("\"%s\"", escaped);
+    fprintf(f, "\"%s\"", escaped);
     free(escaped);
 }
 
-void lval_print(lval* v) {
+void lval_fprint(FILE* f, lval* v) {
     switch (v->type) {
-        case LVAL_NUM:   printf("%li", v->num); break;
-        case LVAL_ERR:   printf("ERROR: %s", v->err); break;
-        case LVAL_SYM:   printf("%s", v->sym); break;
-        case LVAL_STR:   lval_string_print(v); break;
+        case LVAL_NUM:   fprintf(f, "%li", v->num); break;
+        case LVAL_ERR:   fprintf(f, "ERROR: %s", v->err); break;
+        case LVAL_SYM:   fprintf(f, "%s", v->sym); break;
+        case LVAL_STR:   lval_string_print(f, v); break;
         case LVAL_FUN:
              if (v->builtin) {
-                printf("<builtin>");
+                fprintf(f, "<builtin>");
              } else {
-                 printf("(\\ "); lval_print(v->formals);
-                 putchar(' '); lval_print(v->body); putchar(')');
+                 /* formals bound by partial application are not shown.
+                  * once the rest is bound past & every formal is */
+                 int bound = v->env->count;
+                 if (v->variadic && bound > v->arity) {
+                     bound = v->formals->count;
+                 }
+                 fprintf(f, "(\\ ");
+                 lval_expr_print_from(f, v->formals, bound, '{', '}');
+                 putc(' ', f); lval_fprint(f, v->body); putc(')', f);
              }
              break;
-        case LVAL_SEXPR: lval_expr_print(v, '(', ')'); break;
-        case LVAL_QEXPR: lval_expr_print(v, '{', '}'); break;
+        case LVAL_SEXPR: lval_expr_print(f, v, '(', ')'); break;
+        case LVAL_QEXPR: lval_expr_print(f, v, '{', '}'); break;
     }
 }
 
+void lval_print(lval* v) { lval_fprint(stdout, v); }
 void lval_println(lval* v) { lval_print(v); putchar('\n'); }
 
 char* ltype_name(int t) {
@@ -269,9 +379,11 @@ char* ltype_name(int t) {
 }
 
 lenv* lenv_new(void) {
-    lenv* e = malloc(sizeof(lenv));
+    lenv* e = lalloc(sizeof(lenv));
     e->par = NULL;
     e->count = 0;
+    e->cap = 0;
+    e->borrowed = 0;
     e->syms = NULL;
     e->vals = NULL;
     return e;
@@ -279,22 +391,24 @@ lenv* lenv_new(void) {
 
 void lenv_del(lenv* e) {
     for (int i=0; i < e->count; i++) {
-        free(e->syms[i]);
+        if (i >= e->borrowed) { lfree(e->syms[i]); }
         lval_del(e->vals[i]);
     }
-    free(e->syms);
-    free(e->vals);
-    free(e);
+    lfree(e->syms);
+    lfree(e->vals);
+    lfree(e);
 }
 
 lenv* lenv_copy(lenv* e) {
-    lenv* n = malloc(sizeof(lenv));
+    lenv* n = lalloc(sizeof(lenv));
     n->par = e->par;
     n->count = e->count;
-    n->syms = malloc(sizeof(char*) * n->count);
-    n->vals = malloc(sizeof(lval*) * n->count);
+    n->cap = e->count;
+    n->borrowed = 0;
+    n->syms = lalloc(sizeof(char*) * n->count);
+    n->vals = lalloc(sizeof(lval*) * n->count);
     for (int i=0; i < e->count; i++) {
-        n->syms[i] = malloc(strlen(e->syms[i]) + 1);
+        n->syms[i] = lalloc(strlen(e->syms[i]) + 1);
         strcpy(n->syms[i], e->syms[i]);
         n->vals[i] = lval_copy(e->vals[i]);
     }
@@ -306,6 +420,12 @@ void lenv_def(lenv* e, lval* k, lval* v) {
     lenv_put(e, k, v);
 }
 
+/**
+ * called when a symbol is not bound anywhere, with the global environment.
+ * returns 1 if it may have bound it since
+ */
+int (*lenv_on_miss)(lenv* e, char* sym) = NULL;
+
 lval* lenv_get(lenv* e, lval* k) {
     /* iterate to see if variable exists */
     for (int i=0; i < e->count; i++) {
@@ -315,9 +435,24 @@ lval* lenv_get(lenv* e, lval* k) {
     }
     if (e->par) {
         return lenv_get(e->par, k);
-    } else {
-        return lval_err("unbound symbol %s", k->sym);
     }
+    if (lenv_on_miss && lenv_on_miss(e, k->sym)) {
+        return lenv_get(e, k);
+    }
+    return lval_err("unbound symbol %s", k->sym);
+}
+
+/**
+ * like lenv_get, but returns the bound value itself rather than a copy,
+ * or NULL if k is unbound
+ */
+lval* lenv_lookup(lenv* e, char* sym) {
+    for (; e; e = e->par) {
+        for (int i=0; i < e->count; i++) {
+            if (strcmp(e->syms[i], sym) == 0) { return e->vals[i]; }
+        }
+    }
+    return NULL;
 }
 
 void lenv_put(lenv* e, lval* k, lval* v) {
@@ -329,12 +464,102 @@ void lenv_put(lenv* e, lval* k, lval* v) {
             return;
         }
     }
-    /* if not; reallocate and add */
+    /* if not; add */
+    lenv_bind(e, k->sym, lval_copy(v));
+}
+
+/**
+ * add a new binding without looking for an existing one. takes ownership
+ * of v
+ */
+static void lenv_grow(lenv* e) {
+    if (e->count == e->cap) {
+        e->cap = e->cap ? e->cap * 2 : 4;
+        e->vals = lrealloc(e->vals, sizeof(lval*) * e->cap);
+        e->syms = lrealloc(e->syms, sizeof(char*) * e->cap);
+    }
     e->count++;
-    e->vals = realloc(e->vals, sizeof(lval*) * e->count);
-    e->syms = realloc(e->syms, sizeof(char*) * e->count);
+}
+
+void lenv_bind(lenv* e, char* sym, lval* v) {
+    lenv_grow(e);
+    e->vals[e->count-1] = v;
+    e->syms[e->count-1] = lalloc(strlen(sym)+1);
+    strcpy(e->syms[e->count-1], sym);
+}
+
+/**
+ * like lenv_bind, but keeps sym itself rather than a copy. sym must
+ * outlive e, and every binding before this one must be borrowed too
+ */
+void lenv_bind_borrowed(lenv* e, char* sym, lval* v) {
+    lenv_grow(e);
+    e->borrowed++;
+    e->vals[e->count-1] = v;
+    e->syms[e->count-1] = sym;
+}
+
+/**
+ * move v into the existing binding for k, searching outwards from e.
+ * numbers are updated in place. v is consumed either way; returns 0 if
+ * k is not bound anywhere
+ */
+int lenv_set(lenv* e, lval* k, lval* v) {
+    for (; e; e = e->par) {
+        for (int i=0; i < e->count; i++) {
+            if (strcmp(e->syms[i], k->sym) != 0) { continue; }
+
+            lval* old = e->vals[i];
+            if (old->type == LVAL_NUM && v->type == LVAL_NUM) {
+                old->num = v->num;
+                lval_del(v);
+            } else {
+                lval_del(old);
+                e->vals[i] = v;
+            }
+            return 1;
+        }
+    }
+    lval_del(v);
+    return 0;
+}
+
+/**
+ * frames handed out by lenv_push. their symbol and value arrays are kept
+ * between uses, and calls bind the callee's formals with
+ * lenv_bind_borrowed, so entering a scope does not touch the heap unless
+ * it binds more names than the frame has seen before.
+ */
+#define LENV_STACK_SIZE 256
+
+static lenv lenv_stack[LENV_STACK_SIZE];
+static int lenv_depth = 0;
 
-    e->vals[e->count-1] = lval_copy(v);
-    e->syms[e->count-1] = malloc(strlen(k->sym)+1);
-    strcpy(e->syms[e->count-1], k->sym);
+lenv* lenv_push(lenv* par) {
+    lenv* e;
+    if (lenv_depth == LENV_STACK_SIZE) {
+        /* out of frames; fall back to the heap */
+        e = lenv_new();
+    } else {
+        e = &lenv_stack[lenv_depth++];
+        e->count = 0;
+        e->borrowed = 0;
+    }
+    e->par = par;
+    return e;
+}
+
+void lenv_pop(lenv* e) {
+    if (lenv_depth == 0 || e != &lenv_stack[lenv_depth-1]) {
+        lenv_del(e);
+        return;
+    }
+    for (int i=0; i < e->count; i++) {
+        if (i >= e->borrowed) { lfree(e->syms[i]); }
+        lval_del(e->vals[i]);
+    }
+    e->count = 0;
+    e->borrowed = 0;
+    e->par = NULL;
+    lenv_depth--;
 }
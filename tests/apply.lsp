@@ -0,0 +1,12 @@
+; apply and unpack with nothing to apply give the function back
+(print (apply + {}))
+(print (apply - {}))
+(print (apply join {}))
+(print (unpack + {}))
+(print (apply + {1 2 3}))
+(print (apply - {5}))
+(print (apply join {{1} {2 3}}))
+(print (unpack * {2 3 4}))
+(print (curry + {4 5}))
+(print (apply (\ {x y} {- x y}) {10 3}))
+(print (apply (\ {x & r} {r}) {1 2 3}))
@@ -0,0 +1,19 @@
+; lambdas called with exactly their formals run in a scratch frame
+(def {add3} (\ {a b c} {+ a b c}))
+(print (add3 1 2 3))
+(print ((add3 1) 2 3))
+(print (((add3 1) 2) 3))
+(def {pair} (\ {a & r} {join (list a) r}))
+(print (pair 1 2 3))
+(print (pair 1))
+; recursion deeper than the frame stack falls back to the heap
+(def {deep} (\ {n} {if (== n 0) {0} {+ 1 (deep (- n 1))}}))
+(print (deep 300))
+; names bound inside a call do not outlive it
+(def {h} (\ {a} {do (= {z} (* a 2)) (+ z a)}))
+(print (h 4))
+(print (h 5))
+; each formal may appear once
+(print (\ {a a} {a}))
+(print (\ {a b & a} {a}))
+(print (\ {x y} {x}))
@@ -0,0 +1,2 @@
+; grows a list held by a call until the memory quota stops it
+((\ {xs} {while {1} {set! {xs} (join xs {1 2 3 4 5 6 7 8})}}) {})
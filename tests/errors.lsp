@@ -0,0 +1,12 @@
+; argument errors name the function, the argument and what was wrong
+(print (head 1))
+(print (head {}))
+(print (head {1} {2}))
+(print (+ 1 {2}))
+(print (eval 1 2))
+(print (apply 1 {}))
+(print (/ 4 0))
+(print ((\ {a &} {a}) 1))
+; evaluation stops at the first argument that fails
+(print (list (/ 1 0) (print "not reached")))
+(print (error "custom"))
@@ -0,0 +1,5 @@
+; the image given with --image has a function with {5} for formals. it is
+; refused without binding anything from there on, and lispy carries on
+(print (+ 1 2))
+(print id)
+(print bad)
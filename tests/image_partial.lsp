@@ -0,0 +1,5 @@
+; the image given with --image has a function with more partial bindings
+; than formals. it is refused like any other malformed function
+(print (+ 1 2))
+(print id)
+(print bad)
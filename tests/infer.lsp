@@ -0,0 +1,14 @@
+; numeric lambdas run unboxed until an operator turns out not to be
+; arithmetic. that is only found after (work n) has run, and the call is
+; redone the normal way. later calls, through any copy of f, skip straight
+; to the normal way, which keeps this file within its step budget
+(def {work} (\ {n} {if (== n 0) {0} {+ 1 (work (- n 1))}}))
+(def {op} (\ {x} {x}))
+(def {f} (\ {n} {+ (work n) (op 1)}))
+(print (f 2000))
+(def {op} (\ {x} {eval (list x)}))
+(print (f 2000))
+(print (f 2000))
+(def {g} f)
+(print (g 2000))
+(print (f 2000))
@@ -0,0 +1,25 @@
+; numeric lambdas. --emit-c also writes these out as c functions
+(def {fib} (\ {n} {if (< n 2) {n} {+ (fib (- n 1)) (fib (- n 2))}}))
+(print (fib 20))
+(def {gcd} (\ {a b} {if (== b 0) {a} {gcd b (- a (* (/ a b) b))}}))
+(print (gcd 1071 462))
+(def {even} (\ {n} {if (== n 0) {1} {odd (- n 1)}}))
+(def {odd} (\ {n} {if (== n 0) {0} {even (- n 1)}}))
+(print (even 100) (odd 7))
+(def {neg} (\ {x} {- x}))
+(print (neg 5) (neg -9223372036854775807))
+(def {low} (\ {x} {+ x -9223372036854775808}))
+(print (low 1) -9223372036854775808)
+(def {quot} (\ {a b} {/ a b}))
+(print (quot 7 2))
+(print (quot 7 0))
+; operators are looked up when called, so rebinding one still counts
+(def {twice} (\ {x} {* 2 x}))
+(print ((\ {*} {twice 3}) +))
+(print (twice 21))
+; formals of the caller shadow the callee's operators
+(def {apply-op} (\ {x} {op x}))
+(def {op} (\ {x} {+ x 1}))
+(def {shadow} (\ {op} {apply-op op}))
+(print (apply-op 1))
+(print (shadow 1))
@@ -0,0 +1,12 @@
+; partial applications print only the formals left to bind
+(print (\ {a b} {+ a b}))
+(print ((\ {a b} {+ a b}) 1))
+(print ((\ {a b c} {+ a b c}) 1 2))
+(print ((\ {a b & r} {r}) 1))
+(print (\ {& r} {r}))
+(def {add} (\ {a b} {+ a b}))
+(def {inc} (add 1))
+(print inc)
+(print (inc 2))
+(print +)
+(print {1 (2 "three") {}})
@@ -0,0 +1,8 @@
+; data/fill.lsp ran first and hit the quota. the quota is checked between
+; steps, so the peak may pass it by what a single step allocates
+(print (mem "quota"))
+(print (> (mem "peak") (mem "quota")))
+(print (< (mem "peak") (+ (mem "quota") 100000)))
+; what the failed call held has been freed again
+(print (< (mem "current") (mem "quota")))
+(print (join {1 2} {3}))